@@ -1,438 +1,3530 @@
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <vector>
-#include <queue>
 #include <map>
+#include <set>
+#include <list>
+#include <unordered_map>
 #include <algorithm>
 #include <climits>
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <csignal>
 using namespace std;
 
-#define Mode 0 // 定義模式：0為從CSV讀取，1為從控制台讀取
+#define CountAllocations 0 // 定義是否統計堆積配置次數：1為結束時將路徑搜尋的配置次數輸出到stderr
 
-struct Edge {
-    int to, distance, capacity; // 邊的終點、距離和容量
-    bool full; // 邊是否滿載的標志
-    Edge(int t, int d, int c) : to(t), distance(d), capacity(c), full(false) {} // 構造函數
+#if CountAllocations
+#include <cstdlib>
+#include <new>
+size_t allocationCount = 0; // 程式啟動以來operator new的呼叫次數
+void* operator new(size_t n) {
+    ++allocationCount;
+    if (void* p = malloc(n ? n : 1)) return p;
+    throw bad_alloc();
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+#endif
+
+// 讀入時暫存的邊，讀完所有EDGE行後一次性轉成CSR
+struct RawEdge {
+    int s, d, distance, capacity; // 邊的兩端點、距離和容量
+};
+
+// 預留路徑的存放區：路徑的邊編號依序寫進固定大小的區塊，訂單只記住(區塊, 起點, 長度)
+// 每個區塊記錄還有幾條路徑在使用，歸零時整塊回收重複使用，不必逐條配置和釋放
+const int PATH_CHUNK = 1 << 14; // 區塊的邊數，超過此長度的路徑獨占一個剛好大小的區塊
+struct PathSpan {
+    int chunk = -1, offset = 0, length = 0; // 空路徑不佔區塊
+};
+struct PathArena {
+    vector<vector<int>> chunks;
+    vector<int> live; // 各區塊仍在使用的路徑數
+    vector<int> freeChunks; // 沒有路徑在使用的區塊
+    int current = -1, used = 0; // 目前寫入的區塊與已用的長度
+    long long stored = 0, recycled = 0; // 存入的路徑數、整塊回收的次數
+
+    // 換一個至少有length空間的區塊來寫
+    void openChunk(int length) {
+        if (current != -1 && live[current] == 0) freeChunks.push_back(current);
+        int size = max(PATH_CHUNK, length);
+        if (!freeChunks.empty()) {
+            current = freeChunks.back();
+            freeChunks.pop_back();
+            if ((int)chunks[current].size() < size) chunks[current].resize(size);
+        } else {
+            current = chunks.size();
+            chunks.emplace_back(size);
+            live.push_back(0);
+        }
+        used = 0;
+    }
+    PathSpan store(const vector<int>& path) {
+        PathSpan span;
+        if (path.empty()) return span;
+        int length = path.size();
+        if (current == -1 || used + length > (int)chunks[current].size()) openChunk(length);
+        copy(path.begin(), path.end(), chunks[current].begin() + used);
+        span.chunk = current;
+        span.offset = used;
+        span.length = length;
+        used += length;
+        live[current]++;
+        stored++;
+        return span;
+    }
+    void release(PathSpan& span) {
+        int c = span.chunk;
+        span = PathSpan();
+        if (c == -1 || --live[c] > 0) return;
+        recycled++;
+        if (chunks[c].size() > (size_t)PATH_CHUNK) vector<int>(PATH_CHUNK).swap(chunks[c]); // 獨占的大區塊縮回一般大小
+        if (c == current) used = 0; // 目前的區塊從頭再寫
+        else freeChunks.push_back(c);
+    }
+    const int* begin(const PathSpan& span) const { return span.length ? chunks[span.chunk].data() + span.offset : nullptr; }
+    const int* end(const PathSpan& span) const { return begin(span) + span.length; }
+};
+
+// 訂單狀態旗標：送達失敗的活躍訂單同時也在等待重試，所以兩個旗標可以同時成立；都不成立表示已完成
+// OrderBlocked只會和OrderWaiting一起成立，表示在阻擋它的道路或司機改變之前重試一定失敗
+enum OrderState : char { OrderCompleted = 0, OrderActive = 1, OrderWaiting = 2, OrderBlocked = 4 };
+
+// 定義訂單結構
+struct Order {
+    int id, src, ts, driverLocation, driver, distance; // 訂單的基本屬性，包括ID，起始點，交通空間，司機位置，司機編號，總距離
+    char state; // OrderState旗標的組合
+    unsigned blockEpoch; // 每次解除blocked加一，之前登記的喚醒條件隨之失效
+    int watchCount; // blocked時登記的喚醒條件數
+    PathSpan pathToSrc; // 記錄司機到取餐點的路徑(依行進順序的邊編號，存放在pathArena)
+    PathSpan pathToDst; // 記錄取餐點到目的地的路徑(依行進順序的邊編號，存放在pathArena)
+};
+
+// 全局變量定義
+// 圖以壓縮稀疏行(CSR)表示：頂點u的邊連續存放在[adjOffset[u], adjOffset[u + 1])
+// 各欄位分開存放(SoA)，鬆弛時只讀需要的陣列
+vector<int> adjOffset; // 每個頂點第一條邊的位置，長度V + 2
+vector<int> adjTo; // 邊的終點
+vector<int> adjDistance; // 邊的距離
+vector<int> adjEdge; // 邊所屬的道路編號，正反兩向共用同一編號
+// 每條無向道路一個編號(即讀入順序)，正反兩向共用容量
+vector<int> edgeU, edgeV; // 道路的兩端點
+vector<int> edgeDistance; // 道路的距離
+vector<int> edgeCapacity; // 道路的剩餘容量
+vector<int> edgeArcs; // 道路e的兩個方向在adj陣列中的位置為edgeArcs[2e]與edgeArcs[2e + 1]
+vector<RawEdge> rawEdges; // addEdge暫存的邊(產生測試圖時使用)，buildGraph後釋放
+// 司機表(SoA)：司機依讀入順序編號，編號固定不變，訂單記住自己的司機編號
+// 每個頂點有空閒司機數和空閒司機的串列(以driverNext串起)，指派、移動、釋放都是O(1)
+enum DriverState : char { DriverAvailable, DriverBusy };
+vector<int> driverAt; // 司機所在頂點
+vector<DriverState> driverState;
+vector<int> driverOrder; // 司機目前負責的訂單，空閒時為-1
+vector<int> driverNext; // 同一頂點空閒串列中的下一位司機，-1為結尾
+vector<int> freeDriverHead; // 各頂點空閒串列的第一位司機
+vector<int> availableDrivers; // 各頂點的空閒司機數
+vector<int> availableLocations; // 有空閒司機的頂點(無順序)
+vector<int> availableSlot; // 頂點在availableLocations中的位置，沒有空閒司機時為-1
+// 訂單池：所有訂單存放在同一個陣列，外部訂單編號經雜湊索引找到槽位；狀態改變只改旗標，不搬移資料
+// 完成的訂單歸還槽位，槽位的世代編號加一，舊的handle就會失效；路徑放在pathArena，完成時一併歸還
+struct OrderHandle {
+    int slot;
+    unsigned generation;
+};
+vector<Order> orderPool;
+vector<unsigned> orderGeneration; // 各槽位目前的世代編號
+vector<int> freeOrderSlots; // 可重複使用的槽位
+unordered_map<int, int> orderIndex; // 訂單編號 -> 槽位
+// 等待中的訂單依編號分成兩組：readyOrders在下次有訂單完成時重試；blockedOrders從所在位置在容量限制下
+// 走得到的範圍內既沒有空閒司機也沒有目的地，重試一定失敗，直到範圍邊界的道路空出容量或範圍內有司機空閒才移回ready
+set<int> readyOrders;
+set<int> blockedOrders;
+// 喚醒條件：blocked訂單在擋住它的道路與範圍內的頂點各登記一筆，訂單被喚醒或完成後登記就失效，掃描時順便移除
+struct BlockWatch {
+    OrderHandle order;
+    unsigned epoch; // 登記時訂單的blockEpoch
+    int ts; // 道路剩餘容量達到此值時喚醒，頂點的登記不使用
+};
+vector<vector<BlockWatch>> edgeWatchers; // 各道路上的登記
+vector<vector<BlockWatch>> vertexWatchers; // 各頂點上的登記
+size_t watchEntries = 0, liveWatchEntries = 0; // 所有登記數與仍然有效的登記數
+struct WakeStats {
+    long long retries = 0, skipped = 0; // 實際重試與確定失敗而略過的次數
+    long long blocks = 0, wakes = 0;
+};
+WakeStats wakeStats;
+// 批次派單(--batch N)：連續的Order指令先收集起來，滿N張或遇到其他指令時一起指派，使整批的空車距離總和最小
+struct BatchRequest {
+    int id, src, ts;
+};
+int batchSize = 0; // 每批的訂單數，0或1為逐張找最近的司機
+vector<BatchRequest> pendingOrders; // 收集中的訂單(依到達順序)
+struct DispatchStats {
+    long long placed = 0, deadhead = 0; // 成功指派的訂單數與司機到取餐點的距離總和
+    long long batches = 0, planned = 0, fallbacks = 0; // 批次數、依批次結果指派的訂單數、改回逐張處理的訂單數
+    long long claimed = 0, lostClaims = 0; // 工作執行緒同時預留成功的路線數、因容量被搶先扣走而重新查詢的次數
+};
+DispatchStats dispatchStats;
+PathArena pathArena; // 訂單預留的路徑
+int V, E, D; // 頂點數，邊數，司機數
+// 雙向搜尋(--bidirectional N)：頂點數達到N時點對點查詢改用雙向搜尋，-1為不用；兩端相遇的位置取決於取出頂點的順序，
+// 同樣長的路線可能選到與單向搜尋不同的一條，改變之後預留的容量與輸出，所以與覆蓋圖、地標一樣預設不用
+int bidirectionalMinVertices = -1;
+int maxEdgeDistance = 0; // 最長的邊，決定Dial桶佇列的桶數
+// 地標數量(--landmarks N)，0為不建立：有地標時點對點查詢一律用A*(ALT)，優先於雙向搜尋；
+// 地標越多下界越緊、搜尋越少，但每個地標多佔V個int，且A*在同樣長的路線中可能選到另一條，所以預設不用
+int landmarkCount = 0;
+const int ALT_MAX_TARGETS = 16; // 找最近司機時，有空閒司機的位置不超過此數才用地標下界
+
+// 路徑搜尋使用的優先佇列，執行期以--queue選擇；點對點搜尋與分區內搜尋的同距離前驅由preferEarlierPrev決定，
+// 預設的查詢方式下路線不隨佇列改變(--bench逐一比較各佇列選出的路線)；選用的雙向搜尋、A*與覆蓋圖查詢
+// 取出同鍵值頂點的順序會影響結果，換佇列時可能選到另一條同樣長的路線
+enum QueueKind { HeapQueue, RadixQueue, DialQueue };
+QueueKind queueKind = HeapQueue;
+const int DIAL_MAX_BUCKETS = 1 << 20; // 邊長超過此值時Dial改用基數堆，避免桶陣列過大
+// 多層分區覆蓋圖只在--crp時建立：查詢結果一樣短，但同樣長的路線可能選到與一般搜尋不同的一條，改變之後預留的容量與輸出
+bool useOverlay = false;
+int crpCellSize = 256; // 最底層分區的頂點數上限，往上每層放大CRP_LEVEL_FANOUT倍
+const int CRP_LEVEL_FANOUT = 16;
+int maxArcMasks = 64; // 最多為幾種交通量建立封鎖位元組(--arc-masks)，0為逐條檢查容量
+
+// 各種搜尋的統計：查詢次數與取出(確定最短距離)的頂點數，--stats時輸出到stderr
+enum SearchKind { StatDijkstra, StatPointToPoint, StatBidirectional, StatOverlay, StatAlt,
+                  StatNearestDriver, StatAltNearestDriver, StatBatchCandidates, SEARCH_KINDS };
+const char* searchKindNames[SEARCH_KINDS] = {"dijkstra", "point-to-point", "bidirectional", "overlay", "alt",
+                                             "nearest-driver", "alt-nearest-driver", "batch-candidates"};
+struct SearchStats {
+    long long searches = 0, settled = 0;
+};
+thread_local SearchStats searchStats[SEARCH_KINDS]; // 每個執行緒一份，只有主執行緒的會輸出
+bool printStats = false; // --stats
+
+// 整數轉為十進位字串寫到digits(至少11個字元)，傳回長度
+inline int formatInt(int value, char* digits) {
+    char reversed[11];
+    int n = 0;
+    unsigned magnitude = value < 0 ? 0u - (unsigned)value : (unsigned)value;
+    do {
+        reversed[n++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (value < 0) reversed[n++] = '-';
+    for (int i = 0; i < n; ++i) digits[i] = reversed[n - 1 - i];
+    return n;
+}
+
+// 輸出緩衝：字串與整數直接寫進可重複使用的大緩衝區，滿了才整塊寫出，不逐行flush；
+// async時緩衝區排成環狀，由背景執行緒寫出，格式化不必等待I/O
+struct OutputWriter {
+    static const size_t BUFFER_SIZE = 1 << 20;
+    static const int RING_SIZE = 4;
+    int fd = 1;
+    bool async = false;
+    vector<char> buffers[RING_SIZE];
+    size_t lengths[RING_SIZE] = {}; // 已交給背景執行緒的緩衝區長度
+    int head = 0, tail = 0, pending = 0; // 寫入中的緩衝區、下一個要寫出的緩衝區、等待寫出的數量
+    size_t used = 0;
+    bool closing = false;
+    mutex lock;
+    condition_variable changed;
+    thread worker;
+
+    void open(const string& path, bool background) {
+        if (!path.empty()) {
+            fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) {
+                cerr << "cannot open output: " << path << endl;
+                exit(1);
+            }
+        }
+        async = background;
+        for (int i = 0; i < (async ? RING_SIZE : 1); ++i) buffers[i].resize(BUFFER_SIZE);
+        if (async) worker = thread([this]() { drain(); });
+    }
+    static void writeAll(int fd, const char* data, size_t length) {
+        while (length > 0) {
+            ssize_t n = ::write(fd, data, length);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                cerr << "output write failed" << endl;
+                exit(1);
+            }
+            data += n;
+            length -= n;
+        }
+    }
+    void drain() { // 背景執行緒：依序寫出已交出的緩衝區
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            changed.wait(guard, [this]() { return pending > 0 || closing; });
+            if (pending == 0) return;
+            int i = tail;
+            guard.unlock();
+            writeAll(fd, buffers[i].data(), lengths[i]);
+            guard.lock();
+            tail = (tail + 1) % RING_SIZE;
+            pending--;
+            changed.notify_all();
+        }
+    }
+    void submit() { // 交出目前的緩衝區，換下一個空的
+        if (used == 0) return;
+        if (!async) {
+            writeAll(fd, buffers[0].data(), used);
+            used = 0;
+            return;
+        }
+        unique_lock<mutex> guard(lock);
+        lengths[head] = used;
+        pending++;
+        head = (head + 1) % RING_SIZE;
+        changed.notify_all();
+        changed.wait(guard, [this]() { return pending < RING_SIZE; }); // 環滿了才等背景執行緒
+        used = 0;
+    }
+    void put(const char* text, size_t length) {
+        if (used + length > BUFFER_SIZE) submit();
+        memcpy(buffers[head].data() + used, text, length);
+        used += length;
+    }
+    void put(char c) {
+        if (used == BUFFER_SIZE) submit();
+        buffers[head][used++] = c;
+    }
+    void putInt(int value) {
+        if (used + 11 > BUFFER_SIZE) submit();
+        used += formatInt(value, buffers[head].data() + used);
+    }
+    void close() { // 寫出剩下的內容並等背景執行緒結束
+        submit();
+        if (async) {
+            {
+                lock_guard<mutex> guard(lock);
+                closing = true;
+            }
+            changed.notify_all();
+            worker.join();
+        }
+        if (fd != 1) ::close(fd);
+    }
+};
+string outputPath; // --output：輸出檔案，預設為標準輸出
+string inputPath; // --input：輸入檔案，預設為標準輸入
+bool streamMode = false; // --stream：逐行讀取指令並在紀錄確定後輸出，不需要指令數，可讀到管線結束
+bool asyncOutput = false; // --async-output：以背景執行緒寫出
+string listenPath; // --listen：常駐模式的Unix socket路徑
+string connectPath; // --connect：以測試客戶端連到這個socket
+int clientConnections = 1; // --clients：測試客戶端同時開的連線數
+bool foldResponses = false; // --fold：測試客戶端把改派司機的"from"行併回該訂單的第一筆，輸出與檔案模式相同
+bool serving = false; // 常駐模式開始服務後每道指令的紀錄立即送出，改派司機時另外添加"from"紀錄
+
+// 輸出日誌：執行中只記錄種類與數值，結束時才一次轉成文字
+enum LogKind : char { LogNoWayHome, LogOrderFrom, LogOrderDistance };
+struct LogRecord {
+    LogKind kind;
+    int order, value; // 訂單編號與司機位置或總距離，無法送達時不使用
+};
+vector<LogRecord> outputLogs; // 用於儲存最終輸出的日誌
+unordered_map<int, int> orderFromLog; // 訂單編號 -> 該訂單"from"紀錄在outputLogs中的位置
+size_t routingAllocations = 0, routedOrders = 0; // 路徑搜尋期間的配置次數與搜尋次數(CountAllocations時統計)
+
+// 基數堆：鍵值單調不減時，依與上次取出鍵值最高不同位元分桶，每個元素最多搬移32次
+struct RadixHeap {
+    vector<pair<int, int>> bucket[33]; // (距離, 頂點)
+    unsigned last = 0; // 最近一次取出的鍵值
+    size_t count = 0;
+
+    static int index(unsigned key, unsigned last) { return key == last ? 0 : 32 - __builtin_clz(key ^ last); }
+    void clear() {
+        for (auto& b : bucket) b.clear();
+        last = 0;
+        count = 0;
+    }
+    void push(int d, int v) {
+        bucket[index(d, last)].push_back(make_pair(d, v));
+        count++;
+    }
+    void pull() {
+        if (!bucket[0].empty()) return;
+        int i = 1;
+        while (bucket[i].empty()) ++i;
+        unsigned smallest = UINT_MAX;
+        for (const auto& x : bucket[i]) smallest = min(smallest, (unsigned)x.first);
+        last = smallest; // 新的最小值，桶內元素都搬到更低的桶
+        for (const auto& x : bucket[i]) bucket[index(x.first, last)].push_back(x);
+        bucket[i].clear();
+    }
+    pair<int, int> top() {
+        pull();
+        return bucket[0].back();
+    }
+    pair<int, int> pop() {
+        pull();
+        pair<int, int> top = bucket[0].back();
+        bucket[0].pop_back();
+        count--;
+        return top;
+    }
+};
+
+// Dial桶佇列：所有鍵值落在[cursor, cursor + 桶數)內，以環狀的桶陣列存放
+struct BucketQueue {
+    vector<vector<int>> bucket; // 每個桶存放頂點，鍵值即桶所代表的距離
+    size_t count = 0;
+    int cursor = 0; // 目前最小鍵值的下界
+
+    void clear(int width) {
+        if ((int)bucket.size() != width) { // 換了圖：重新配置，舊的桶一併丟棄
+            bucket.assign(width, vector<int>());
+            count = 0;
+        }
+        for (int d = cursor; count > 0; ++d) { // 只清理上次查詢提早結束時留下的桶
+            vector<int>& b = bucket[d % bucket.size()];
+            count -= b.size();
+            b.clear();
+        }
+        cursor = 0;
+    }
+    void push(int d, int v) {
+        if (d < cursor) cursor = d;
+        bucket[d % bucket.size()].push_back(v);
+        count++;
+    }
+    void advance() {
+        while (bucket[cursor % bucket.size()].empty()) ++cursor;
+    }
+    pair<int, int> top() {
+        advance();
+        return make_pair(cursor, bucket[cursor % bucket.size()].back());
+    }
+    pair<int, int> pop() {
+        advance();
+        vector<int>& b = bucket[cursor % bucket.size()];
+        pair<int, int> top = make_pair(cursor, b.back());
+        b.pop_back();
+        count--;
+        return top;
+    }
+};
+
+// 可重複使用的搜尋工作區：距離與前驅陣列以世代編號標記，不必每次查詢都重設整個陣列
+// 只有stamp[v] == generation的頂點才算本次查詢已寫入，查詢的準備成本只和碰到的頂點數有關
+struct SearchContext {
+    vector<int> distance; // 距離陣列
+    vector<int> prevEdge; // 前驅道路陣列，記錄到達每個頂點所用的道路編號
+    vector<int> potential; // A*搜尋時頂點的下界估計，與distance同時寫入
+    vector<unsigned> stamp; // 每個頂點最後一次被寫入時的世代編號
+    unsigned generation = 0; // 目前查詢的世代編號
+    QueueKind kind = HeapQueue; // 本次查詢使用的佇列
+    vector<pair<int, int>> heap; // 二元最小堆，(距離, 頂點)
+    RadixHeap radix;
+    BucketQueue dial;
+    vector<int>* trace = nullptr; // 推測重播時記錄本次查詢碰到的頂點(見replayCommands)
+
+    void begin() {
+        if (stamp.size() != (size_t)V + 1) { // 第一次使用或圖大小改變時才配置
+            distance.assign(V + 1, INT_MAX);
+            prevEdge.assign(V + 1, -1);
+            potential.assign(V + 1, 0);
+            stamp.assign(V + 1, 0);
+            generation = 0;
+        }
+        if (++generation == 0) { // 世代編號溢位時才整個清除一次
+            fill(stamp.begin(), stamp.end(), 0);
+            generation = 1;
+        }
+        kind = queueKind;
+        // A*的鍵值每步最多增加兩倍邊長(邊長加上下界的變化)，桶數要能涵蓋
+        if (kind == DialQueue && 2 * maxEdgeDistance + 1 > DIAL_MAX_BUCKETS) kind = RadixQueue;
+        heap.clear();
+        radix.clear();
+        if (kind == DialQueue) dial.clear(2 * maxEdgeDistance + 1);
+    }
+    int dist(int v) const { return stamp[v] == generation ? distance[v] : INT_MAX; }
+    void set(int v, int d, int e) {
+        if (trace && stamp[v] != generation) trace->push_back(v);
+        stamp[v] = generation;
+        distance[v] = d;
+        prevEdge[v] = e;
+    }
+    // 佇列操作，鍵值必須單調不減(Dijkstra推入的距離不小於最近取出的距離)
+    bool empty() const {
+        if (kind == RadixQueue) return radix.count == 0;
+        if (kind == DialQueue) return dial.count == 0;
+        return heap.empty();
+    }
+    size_t size() const {
+        if (kind == RadixQueue) return radix.count;
+        if (kind == DialQueue) return dial.count;
+        return heap.size();
+    }
+    int topKey() {
+        if (kind == RadixQueue) return radix.top().first;
+        if (kind == DialQueue) return dial.top().first;
+        return heap.front().first;
+    }
+    void push(int d, int v) {
+        if (kind == RadixQueue) return radix.push(d, v);
+        if (kind == DialQueue) return dial.push(d, v);
+        heap.push_back(make_pair(d, v));
+        push_heap(heap.begin(), heap.end(), greater<pair<int, int>>());
+    }
+    pair<int, int> pop() {
+        if (kind == RadixQueue) return radix.pop();
+        if (kind == DialQueue) return dial.pop();
+        pop_heap(heap.begin(), heap.end(), greater<pair<int, int>>());
+        pair<int, int> top = heap.back();
+        heap.pop_back();
+        return top;
+    }
+};
+thread_local SearchContext searchContext[2]; // 每個執行緒一組，雙向搜尋需要兩個
+
+inline size_t allocationMark() {
+#if CountAllocations
+    return allocationCount;
+#else
+    return 0;
+#endif
+}
+
+inline void countRouting(size_t mark) {
+    routingAllocations += allocationMark() - mark; // 累計這次路徑搜尋期間的配置次數
+    routedOrders++;
+}
+
+// 函數定義
+void addEdge(int s, int d, int dis, int t) {
+    rawEdges.push_back((RawEdge){s, d, dis, t}); // 先暫存，等buildGraph統一建圖
+}
+
+// 由道路表(edgeU、edgeV、edgeDistance、edgeCapacity)建立CSR
+void buildAdjacency() {
+    int edges = edgeU.size();
+    // 第一遍：計算每個頂點的度數
+    adjOffset.assign(V + 2, 0);
+    for (int id = 0; id < edges; ++id) {
+        adjOffset[edgeU[id] + 1]++; // 正向邊
+        adjOffset[edgeV[id] + 1]++; // 反向邊，因為是無向圖
+    }
+    for (int u = 0; u <= V; ++u) adjOffset[u + 1] += adjOffset[u]; // 前綴和得到起始位置
+
+    // 第二遍：依讀入順序填入，保持與逐條push_back相同的邊順序
+    int arcs = adjOffset[V + 1];
+    adjTo.resize(arcs);
+    adjDistance.resize(arcs);
+    adjEdge.resize(arcs);
+    edgeArcs.resize(2 * edges);
+    maxEdgeDistance = 0;
+    vector<int> pos(adjOffset.begin(), adjOffset.end() - 1); // 每個頂點下一個空位
+    for (int id = 0; id < edges; ++id) {
+        int s = edgeU[id], d = edgeV[id], distance = edgeDistance[id];
+        maxEdgeDistance = max(maxEdgeDistance, distance);
+        int i = pos[s]++;
+        adjTo[i] = d; adjDistance[i] = distance; adjEdge[i] = id; edgeArcs[2 * id] = i;
+        i = pos[d]++;
+        adjTo[i] = s; adjDistance[i] = distance; adjEdge[i] = id; edgeArcs[2 * id + 1] = i;
+    }
+}
+
+void buildGraph() {
+    int edges = rawEdges.size();
+    edgeU.resize(edges);
+    edgeV.resize(edges);
+    edgeDistance.resize(edges);
+    edgeCapacity.resize(edges);
+    for (int id = 0; id < edges; ++id) {
+        const RawEdge& e = rawEdges[id];
+        edgeU[id] = e.s; edgeV[id] = e.d; edgeDistance[id] = e.distance; edgeCapacity[id] = e.capacity;
+    }
+    vector<RawEdge>().swap(rawEdges); // 釋放暫存
+    buildAdjacency();
+}
+
+inline int otherEnd(int e, int u) {
+    return edgeU[e] ^ edgeV[e] ^ u; // 道路另一端的頂點
+}
+
+int pathDistance(const vector<int>& path) {
+    int total = 0;
+    for (int e : path) total += edgeDistance[e]; // 累加路徑上每條道路的距離
+    return total;
+}
+
+// 依交通量分開的封鎖位元組：blockedArcs[ts]的第i個位元表示adj陣列位置i的邊剩餘容量不足ts
+// 第一次以某個ts搜尋時建立，之後容量改變時由changeCapacity更新跨過門檻的位元；
+// 尖峰時段塞滿的路段很多，搜尋時一次讀64條邊的狀態就能整批略過
+map<int, vector<uint64_t>> blockedArcs;
+
+// 道路容量的讀取：批次派單時工作執行緒會以claimPath同時扣除容量，所以搜尋以原子操作讀取(x86上與一般讀取相同)
+inline int loadCapacity(int e) {
+    return __atomic_load_n(&edgeCapacity[e], __ATOMIC_RELAXED);
+}
+thread_local bool liveCapacity = false; // 容量正被其他執行緒扣除：位元組已過時，搜尋改為逐條讀取容量
+
+// 搜尋時的容量過濾：有位元組時逐字展開可用的邊，否則逐條檢查容量
+struct ArcFilter {
+    const uint64_t* blocked;
+    int ts;
+
+    // 對u每條容量足夠的邊i呼叫f(i)，順序與adj陣列相同
+    template <class F>
+    void forEach(int u, F&& f) const {
+        int begin = adjOffset[u], end = adjOffset[u + 1];
+        if (!blocked) {
+            for (int i = begin; i < end; ++i) {
+                if (loadCapacity(adjEdge[i]) >= ts) f(i);
+            }
+            return;
+        }
+        for (int word = begin >> 6; word << 6 < end; ++word) {
+            uint64_t bits = ~blocked[word];
+            if (word == begin >> 6) bits &= ~0ULL << (begin & 63);
+            if ((word + 1) << 6 > end) bits &= (1ULL << (end & 63)) - 1;
+            while (bits) {
+                f((word << 6) + __builtin_ctzll(bits));
+                bits &= bits - 1;
+            }
+        }
+    }
+};
+
+ArcFilter arcFilter(int ts) {
+    if (ts <= 0 || liveCapacity) return ArcFilter{nullptr, ts}; // 容量不會是負數，沒有邊會被擋下
+    auto it = blockedArcs.find(ts);
+    if (it == blockedArcs.end()) {
+        if ((int)blockedArcs.size() >= maxArcMasks) return ArcFilter{nullptr, ts};
+        vector<uint64_t>& mask = blockedArcs[ts];
+        mask.assign((adjTo.size() + 63) / 64, 0);
+        for (size_t i = 0; i < adjTo.size(); ++i) {
+            if (edgeCapacity[adjEdge[i]] < ts) mask[i >> 6] |= 1ULL << (i & 63);
+        }
+        it = blockedArcs.find(ts);
+    }
+    return ArcFilter{it->second.data(), ts};
+}
+
+// 最短路徑快取：依(src, dst, ts)記住最近用過的點對點查詢結果
+// 容量減少只會讓可走的路變少，只要結果用到的道路都還容得下ts，結果就仍是最短的；
+// 容量增加可能出現更短的路，所以每個ts有一個解除封鎖的世代編號，編號改變後該ts的舊結果全部作廢
+struct PathCacheEntry {
+    int src, dst, ts;
+    unsigned epoch; // 建立時ts的解除封鎖世代編號
+    bool found;
+    vector<int> edges; // 路徑依行進順序經過的道路
+};
+struct PathCacheKey {
+    int src, dst, ts;
+    bool operator==(const PathCacheKey& other) const { return src == other.src && dst == other.dst && ts == other.ts; }
+};
+struct PathCacheKeyHash {
+    size_t operator()(const PathCacheKey& k) const {
+        return hash<long long>()(((long long)k.src * 1000003 + k.dst) * 1000003 + k.ts);
+    }
+};
+struct PathCacheStats {
+    long long lookups = 0, hits = 0;
+    long long blocked = 0, freed = 0; // 因道路被佔滿、因道路空出而作廢的次數
+};
+int pathCacheSize = 1024; // 快取項目數上限(--path-cache)，0為不快取
+list<PathCacheEntry> pathCache; // 越前面越近期使用
+unordered_map<PathCacheKey, list<PathCacheEntry>::iterator, PathCacheKeyHash> pathCacheIndex;
+map<int, unsigned> unblockEpoch; // 有快取項目的ts各自的解除封鎖世代編號
+PathCacheStats pathCacheStats;
+
+// 取得仍然有效的項目並移到最前面；過期的項目直接刪除
+PathCacheEntry* findCached(int src, int dst, int ts) {
+    if (pathCacheSize <= 0) return nullptr;
+    pathCacheStats.lookups++;
+    auto it = pathCacheIndex.find(PathCacheKey{src, dst, ts});
+    if (it == pathCacheIndex.end()) return nullptr;
+    PathCacheEntry& entry = *it->second;
+    bool valid = entry.epoch == unblockEpoch[ts];
+    if (!valid) {
+        pathCacheStats.freed++;
+    } else {
+        for (int e : entry.edges) {
+            if (edgeCapacity[e] < ts) {
+                valid = false;
+                pathCacheStats.blocked++;
+                break;
+            }
+        }
+    }
+    if (!valid) {
+        pathCache.erase(it->second);
+        pathCacheIndex.erase(it);
+        return nullptr;
+    }
+    pathCache.splice(pathCache.begin(), pathCache, it->second);
+    pathCacheStats.hits++;
+    return &entry;
+}
+
+// 新增項目(呼叫前findCached已確認不存在)；滿了就回收最久沒用的項目，沿用它的緩衝區
+PathCacheEntry& storeCached(int src, int dst, int ts, bool found) {
+    if ((int)pathCache.size() >= pathCacheSize) {
+        const PathCacheEntry& old = pathCache.back();
+        pathCacheIndex.erase(PathCacheKey{old.src, old.dst, old.ts});
+        pathCache.splice(pathCache.begin(), pathCache, prev(pathCache.end()));
+    } else {
+        pathCache.emplace_front();
+    }
+    PathCacheEntry& entry = pathCache.front();
+    entry.src = src;
+    entry.dst = dst;
+    entry.ts = ts;
+    entry.epoch = unblockEpoch[ts];
+    entry.found = found;
+    entry.edges.clear();
+    pathCacheIndex[PathCacheKey{src, dst, ts}] = pathCache.begin();
+    return entry;
+}
+
+// 從src出發的完整Dijkstra，結果留在searchContext[0]
+void dijkstraSearch(int src, int ts) {
+    searchStats[StatDijkstra].searches++;
+    SearchContext& sc = searchContext[0];
+    sc.begin();
+    sc.set(src, 0, -1);
+    sc.push(0, src);
+    const ArcFilter usable = arcFilter(ts);
+
+    while (!sc.empty()) {
+        pair<int, int> top = sc.pop();
+        int d = top.first;
+        int u = top.second;
+        if (d > sc.dist(u)) continue; // 當前點的距離如果大於已知最短距離則跳過
+        searchStats[StatDijkstra].settled++;
+        usable.forEach(u, [&](int i) {
+            int v = adjTo[i];
+            int weight = adjDistance[i];
+            if (d + weight < sc.dist(v)) { // 更新距離
+                sc.set(v, d + weight, adjEdge[i]);
+                sc.push(d + weight, v);
+            }
+        });
+    }
+}
+
+// 鬆弛時走到同樣的距離：已取出的u(距離du)經由道路e也能以最短距離到達v。保留(距離, 頂點編號)較小的前驅，
+// 也就是二元堆先取出的那一個，換成基數堆或Dial桶佇列時選到的路線不變(二元堆不會觸發)；零長度的邊不處理
+inline void preferEarlierPrev(SearchContext& sc, int v, int u, int du, int e) {
+    if (du == sc.dist(v)) return;
+    int p = otherEnd(sc.prevEdge[v], v), dp = sc.dist(p);
+    if (du < dp || (du == dp && u < p)) sc.prevEdge[v] = e;
+}
+
+bool pointToPointSearch(int src, int dst, int ts, vector<int>& path) {
+    searchStats[StatPointToPoint].searches++;
+    SearchContext& sc = searchContext[0];
+    sc.begin();
+    sc.set(src, 0, -1);
+    sc.push(0, src);
+    const ArcFilter usable = arcFilter(ts);
+
+    while (!sc.empty()) {
+        pair<int, int> top = sc.pop();
+        int d = top.first;
+        int u = top.second;
+        if (d > sc.dist(u)) continue;
+        searchStats[StatPointToPoint].settled++;
+        if (u == dst) break; // 終點已確定最短距離，不必展開其餘頂點
+        usable.forEach(u, [&](int i) {
+            int v = adjTo[i];
+            int weight = adjDistance[i];
+            if (d + weight < sc.dist(v)) {
+                sc.set(v, d + weight, adjEdge[i]);
+                sc.push(d + weight, v);
+            } else if (d + weight == sc.dist(v)) {
+                preferEarlierPrev(sc, v, u, d, adjEdge[i]);
+            }
+        });
+    }
+
+    path.clear();
+    if (sc.dist(dst) == INT_MAX) return false; // 如果沒有找到路徑，返回false
+
+    for (int current = dst; current != src; current = otherEnd(sc.prevEdge[current], current)) {
+        path.push_back(sc.prevEdge[current]); // 沿前驅道路回溯
+    }
+    reverse(path.begin(), path.end()); // 反轉路徑以獲得正確的方向
+    return true;
+}
+
+bool bidirectionalSearch(int src, int dst, int ts, vector<int>& path) {
+    searchStats[StatBidirectional].searches++;
+    // 正向從src、反向從dst同時搜尋，圖為無向且容量雙向共用，兩邊用同一個過濾條件
+    SearchContext* sc = searchContext;
+    sc[0].begin();
+    sc[1].begin();
+    sc[0].set(src, 0, -1);
+    sc[1].set(dst, 0, -1);
+    sc[0].push(0, src);
+    sc[1].push(0, dst);
+    int best = src == dst ? 0 : INT_MAX; // 目前找到的最短路徑長度
+    int meet = src == dst ? src : -1; // 兩邊搜尋相遇的頂點
+    const ArcFilter usable = arcFilter(ts);
+
+    while (!sc[0].empty() && !sc[1].empty()) {
+        // 兩邊堆頂之和不小於已知最短路徑時，不可能再找到更短的路徑
+        if ((long long)sc[0].topKey() + sc[1].topKey() >= best) break;
+        int side = sc[0].size() <= sc[1].size() ? 0 : 1; // 展開較小的一邊
+        pair<int, int> top = sc[side].pop();
+        int d = top.first;
+        int u = top.second;
+        if (d > sc[side].dist(u)) continue;
+        searchStats[StatBidirectional].settled++;
+        usable.forEach(u, [&](int i) {
+            int v = adjTo[i];
+            int weight = adjDistance[i];
+            if (d + weight < sc[side].dist(v)) {
+                sc[side].set(v, d + weight, adjEdge[i]);
+                sc[side].push(d + weight, v);
+                int other = sc[1 - side].dist(v);
+                if (other != INT_MAX && d + weight + other < best) {
+                    best = d + weight + other; // 經過v連接兩邊的路徑更短
+                    meet = v;
+                }
+            }
+        });
+    }
+
+    path.clear();
+    if (meet == -1) return false; // 如果沒有找到路徑，返回false
+
+    for (int current = meet; current != src; current = otherEnd(sc[0].prevEdge[current], current)) {
+        path.push_back(sc[0].prevEdge[current]); // 正向部分：從相遇點回溯到src
+    }
+    reverse(path.begin(), path.end());
+    for (int current = meet; current != dst; current = otherEnd(sc[1].prevEdge[current], current)) {
+        path.push_back(sc[1].prevEdge[current]); // 反向部分：從相遇點回溯到dst正好是行進順序
+    }
+    return true;
+}
+
+// 地標距離表(ALT)：landmarkDist[v * landmarks + k]為第k個地標到v不考慮容量的距離
+// 容量過濾只會移除道路，由三角不等式得到的下界對任何ts都成立，可作為A*的啟發函數
+vector<int> landmarkDist;
+int landmarks = 0; // 實際建立的地標數
+
+void buildLandmarks() {
+    landmarks = 0;
+    vector<int> table; // 先依地標存放，最後轉成依頂點存放，查詢時同一頂點的各地標距離相鄰
+    vector<int> nearest(V + 1, INT_MAX); // 每個頂點到已選地標的最近距離
+    int next = 1;
+    // 最遠點選法：每次選離現有地標最遠的頂點，到不了的頂點優先，使每個連通塊都有地標
+    while (landmarks < landmarkCount && next >= 1 && next <= V) {
+        dijkstraSearch(next, INT_MIN); // 不考慮容量
+        for (int v = 0; v <= V; ++v) {
+            table.push_back(searchContext[0].dist(v));
+            nearest[v] = min(nearest[v], searchContext[0].dist(v));
+        }
+        landmarks++;
+        next = 1;
+        for (int v = 2; v <= V; ++v) {
+            if (nearest[v] > nearest[next]) next = v;
+        }
+        if (nearest[next] == 0) break; // 所有頂點都已是地標
+    }
+    landmarkDist.assign((size_t)landmarks * (V + 1), INT_MAX);
+    for (int k = 0; k < landmarks; ++k) {
+        for (int v = 0; v <= V; ++v) landmarkDist[(size_t)v * landmarks + k] = table[(size_t)k * (V + 1) + v];
+    }
+}
+
+// v到t距離的下界；由地標可知兩者不連通時傳回INT_MAX
+inline int landmarkBound(int v, int t) {
+    const int* a = &landmarkDist[(size_t)v * landmarks];
+    const int* b = &landmarkDist[(size_t)t * landmarks];
+    int best = 0;
+    for (int k = 0; k < landmarks; ++k) {
+        if (a[k] == INT_MAX || b[k] == INT_MAX) {
+            if (a[k] != b[k]) return INT_MAX; // 只有一邊到得了這個地標
+            continue;
+        }
+        best = max(best, abs(a[k] - b[k]));
+    }
+    return best;
+}
+
+bool altSearch(int src, int dst, int ts, vector<int>& path) {
+    searchStats[StatAlt].searches++;
+    SearchContext& sc = searchContext[0];
+    sc.begin();
+    path.clear();
+    int h = landmarkBound(src, dst);
+    if (h == INT_MAX) return false;
+    sc.set(src, 0, -1);
+    sc.potential[src] = h;
+    sc.push(h, src);
+    const ArcFilter usable = arcFilter(ts);
+
+    while (!sc.empty()) {
+        pair<int, int> top = sc.pop();
+        int u = top.second;
+        int d = sc.dist(u);
+        if (top.first - sc.potential[u] > d) continue; // 鍵值為距離加下界
+        searchStats[StatAlt].settled++;
+        if (u == dst) break;
+        usable.forEach(u, [&](int i) {
+            int v = adjTo[i];
+            int weight = adjDistance[i];
+            if (d + weight < sc.dist(v)) {
+                int hv = sc.dist(v) == INT_MAX ? landmarkBound(v, dst) : sc.potential[v];
+                if (hv == INT_MAX) return; // 和終點不連通
+                sc.set(v, d + weight, adjEdge[i]);
+                sc.potential[v] = hv;
+                sc.push(d + weight + hv, v);
+            }
+        });
+    }
+
+    if (sc.dist(dst) == INT_MAX) return false; // 如果沒有找到路徑，返回false
+    for (int current = dst; current != src; current = otherEnd(sc.prevEdge[current], current)) {
+        path.push_back(sc.prevEdge[current]); // 沿前驅道路回溯
+    }
+    reverse(path.begin(), path.end());
+    return true;
+}
+
+// 多層分區覆蓋圖(customizable route planning)
+// 載入時把圖切成多層巢狀分區，每個分區預先算好邊界頂點兩兩之間在分區內的最短距離(邊界團)
+// 距離受容量過濾影響，所以每個ts各有一份客製化結果；容量改變時只把受影響的分區標為需重算，
+// 等查詢用到這些分區時才重算，其餘分區的結果沿用
+struct OverlayLevel {
+    vector<int> cell; // 每個頂點所屬的分區
+    int cells = 0;
+    vector<int> boundaryStart; // 分區c的邊界頂點位於boundary[boundaryStart[c], boundaryStart[c + 1])
+    vector<int> boundary;
+    vector<int> boundaryIndex; // 頂點在所屬分區邊界清單中的位置，非邊界頂點為-1
+    vector<long long> matrixStart; // 分區c的邊界團距離矩陣在weight中的起始位置
+    long long matrixSize = 0;
+    vector<int> childStart, children; // 分區c包含的下一層分區位於children[childStart[c], childStart[c + 1])
 };
+struct Customization {
+    int ts;
+    vector<vector<int>> weight; // 每層的邊界團距離，無法到達為INT_MAX
+    vector<vector<char>> dirty; // 每層每個分區內部的道路是否改變過
+    vector<vector<char>> pending; // 分區本身或其下層分區是否有待重算的內容
+};
+vector<OverlayLevel> overlay; // overlay[0]為最底層
+// 依ts分開的客製化結果，每份約與覆蓋圖一樣大；最多保留maxCustomizations份，滿了回收最久沒用的
+int maxCustomizations = 8; // --crp-customizations
+list<Customization> customizations; // 越前面越近期使用
+unordered_map<int, list<Customization>::iterator> customizationIndex; // ts -> 客製化結果
+
+void buildOverlay() {
+    overlay.clear();
+    customizations.clear();
+    customizationIndex.clear();
+    vector<int> queue;
+    for (long long size = crpCellSize; ; size *= CRP_LEVEL_FANOUT) {
+        OverlayLevel level;
+        level.cell.assign(V + 1, -1);
+        if (overlay.empty()) {
+            // 最底層：依編號順序挑選未分配的頂點，以BFS長出最多crpCellSize個頂點的分區
+            for (int start = 0; start <= V; ++start) {
+                if (level.cell[start] != -1) continue;
+                int c = level.cells++, count = 0;
+                queue.assign(1, start);
+                level.cell[start] = c;
+                for (size_t head = 0; head < queue.size() && count < size; ++head) {
+                    int u = queue[head];
+                    count++;
+                    for (int i = adjOffset[u]; i < adjOffset[u + 1] && (long long)queue.size() < size; ++i) {
+                        if (level.cell[adjTo[i]] == -1) {
+                            level.cell[adjTo[i]] = c;
+                            queue.push_back(adjTo[i]);
+                        }
+                    }
+                }
+            }
+        } else {
+            // 上層：把下一層相鄰的分區以BFS合併，直到頂點數達到上限
+            const OverlayLevel& lower = overlay.back();
+            vector<vector<int>> members(lower.cells);
+            for (int v = 0; v <= V; ++v) members[lower.cell[v]].push_back(v);
+            vector<int> parent(lower.cells, -1);
+            for (int seed = 0; seed < lower.cells; ++seed) {
+                if (parent[seed] != -1) continue;
+                int c = level.cells++;
+                long long count = 0;
+                queue.assign(1, seed);
+                parent[seed] = c;
+                for (size_t head = 0; head < queue.size(); ++head) {
+                    int sub = queue[head];
+                    count += members[sub].size();
+                    if (count >= size) continue; // 已滿，不再往外擴張
+                    for (int u : members[sub]) {
+                        for (int i = adjOffset[u]; i < adjOffset[u + 1]; ++i) {
+                            int next = lower.cell[adjTo[i]];
+                            if (parent[next] == -1) {
+                                parent[next] = c;
+                                queue.push_back(next);
+                            }
+                        }
+                    }
+                }
+            }
+            for (int v = 0; v <= V; ++v) level.cell[v] = parent[lower.cell[v]];
+            level.childStart.assign(level.cells + 1, 0);
+            for (int sub = 0; sub < lower.cells; ++sub) level.childStart[parent[sub] + 1]++;
+            for (int c = 0; c < level.cells; ++c) level.childStart[c + 1] += level.childStart[c];
+            level.children.resize(lower.cells);
+            vector<int> next(level.childStart.begin(), level.childStart.end() - 1);
+            for (int sub = 0; sub < lower.cells; ++sub) level.children[next[parent[sub]]++] = sub;
+        }
+        // 分區太少(上層的邊界團又大又常需重算，得不償失)或已無法再合併(例如各自獨立的連通塊)時不必再往上建
+        if (level.cells < CRP_LEVEL_FANOUT || (!overlay.empty() && level.cells == overlay.back().cells)) break;
+
+        // 邊界頂點：有邊連到其他分區的頂點
+        level.boundaryIndex.assign(V + 1, -1);
+        level.boundaryStart.assign(level.cells + 1, 0);
+        vector<char> isBoundary(V + 1, 0);
+        for (int u = 0; u <= V; ++u) {
+            for (int i = adjOffset[u]; i < adjOffset[u + 1]; ++i) {
+                if (level.cell[adjTo[i]] != level.cell[u]) isBoundary[u] = 1;
+            }
+            if (isBoundary[u]) level.boundaryStart[level.cell[u] + 1]++;
+        }
+        for (int c = 0; c < level.cells; ++c) level.boundaryStart[c + 1] += level.boundaryStart[c];
+        level.boundary.resize(level.boundaryStart[level.cells]);
+        vector<int> pos(level.boundaryStart.begin(), level.boundaryStart.end() - 1);
+        for (int u = 0; u <= V; ++u) {
+            if (!isBoundary[u]) continue;
+            int c = level.cell[u];
+            level.boundaryIndex[u] = pos[c] - level.boundaryStart[c];
+            level.boundary[pos[c]++] = u;
+        }
+        level.matrixStart.resize(level.cells);
+        for (int c = 0; c < level.cells; ++c) {
+            long long k = level.boundaryStart[c + 1] - level.boundaryStart[c];
+            level.matrixStart[c] = level.matrixSize;
+            level.matrixSize += k * k;
+        }
+        overlay.push_back(level);
+    }
+}
+
+// 在第level層的分區c內(不離開分區)以原圖做Dijkstra，結果留在sc；stopAt >= 0時取出該點即停止
+void cellSearch(SearchContext& sc, int level, int c, int src, int ts, int stopAt) {
+    const vector<int>& cell = overlay[level].cell;
+    sc.begin();
+    sc.set(src, 0, -1);
+    sc.push(0, src);
+    const ArcFilter usable = arcFilter(ts);
+    while (!sc.empty()) {
+        pair<int, int> top = sc.pop();
+        int d = top.first;
+        int u = top.second;
+        if (d > sc.dist(u)) continue;
+        if (u == stopAt) break;
+        usable.forEach(u, [&](int i) {
+            int v = adjTo[i];
+            if (cell[v] != c) return;
+            if (d + adjDistance[i] < sc.dist(v)) {
+                sc.set(v, d + adjDistance[i], adjEdge[i]);
+                sc.push(d + adjDistance[i], v);
+            } else if (d + adjDistance[i] == sc.dist(v)) {
+                preferEarlierPrev(sc, v, u, d, adjEdge[i]);
+            }
+        });
+    }
+}
+
+// 重算第level層分區c的邊界團：最底層直接在原圖上搜尋，上層在下一層的覆蓋圖上搜尋
+// 傳回邊界團是否有任何距離改變，沒改變時上層分區不必跟著重算
+bool customizeCell(Customization& cust, int level, int c, int ts) {
+    bool changed = false;
+    const OverlayLevel& ov = overlay[level];
+    SearchContext& sc = searchContext[1];
+    int first = ov.boundaryStart[c], k = ov.boundaryStart[c + 1] - first;
+    int* weight = &cust.weight[level][ov.matrixStart[c]];
+    const ArcFilter usable = arcFilter(ts);
+    for (int a = 0; a < k; ++a) {
+        int src = ov.boundary[first + a];
+        if (level == 0) {
+            cellSearch(sc, 0, c, src, ts, -1);
+        } else {
+            const OverlayLevel& lower = overlay[level - 1];
+            const vector<int>& lowerWeight = cust.weight[level - 1];
+            sc.begin();
+            sc.set(src, 0, -1);
+            sc.push(0, src);
+            while (!sc.empty()) {
+                pair<int, int> top = sc.pop();
+                int d = top.first;
+                int u = top.second;
+                if (d > sc.dist(u)) continue;
+                int sub = lower.cell[u];
+                int subFirst = lower.boundaryStart[sub], subK = lower.boundaryStart[sub + 1] - subFirst;
+                const int* row = &lowerWeight[lower.matrixStart[sub] + (long long)lower.boundaryIndex[u] * subK];
+                for (int j = 0; j < subK; ++j) { // 下一層分區的邊界團
+                    int v = lower.boundary[subFirst + j];
+                    if (row[j] != INT_MAX && d + row[j] < sc.dist(v)) {
+                        sc.set(v, d + row[j], -1);
+                        sc.push(d + row[j], v);
+                    }
+                }
+                usable.forEach(u, [&](int i) { // 同一分區內連接不同子分區的邊
+                    int v = adjTo[i];
+                    if (lower.cell[v] == sub || ov.cell[v] != c) return;
+                    if (d + adjDistance[i] < sc.dist(v)) {
+                        sc.set(v, d + adjDistance[i], adjEdge[i]);
+                        sc.push(d + adjDistance[i], v);
+                    }
+                });
+            }
+        }
+        for (int b = 0; b < k; ++b) {
+            int d = sc.dist(ov.boundary[first + b]);
+            if (weight[(long long)a * k + b] != d) changed = true;
+            weight[(long long)a * k + b] = d;
+        }
+    }
+    return changed;
+}
+
+// 確保第level層分區c的邊界團是最新的：子分區先重算，只有自己的道路改變或子分區的邊界團改變時才重算自己；
+// 重算後邊界團有變時把上層分區標為需重算
+void ensureCustomized(Customization& cust, int level, int c, int ts) {
+    if (!cust.pending[level][c]) return;
+    cust.pending[level][c] = 0;
+    const OverlayLevel& ov = overlay[level];
+    if (level > 0) {
+        for (int i = ov.childStart[c]; i < ov.childStart[c + 1]; ++i) ensureCustomized(cust, level - 1, ov.children[i], ts);
+    }
+    if (!cust.dirty[level][c]) return;
+    cust.dirty[level][c] = 0;
+    if (customizeCell(cust, level, c, ts) && level + 1 < (int)overlay.size()) {
+        int parent = overlay[level + 1].cell[ov.boundary[ov.boundaryStart[c]]]; // 有變動表示至少有一個邊界頂點
+        cust.dirty[level + 1][parent] = 1;
+    }
+}
+
+// 取得ts的客製化結果並移到最前面；分區只在查詢實際用到時才重算(見ensureCustomized)
+// 新的ts在滿了時沿用最久沒用的那份的陣列，全部標為需重算
+Customization& customizeOverlay(int ts) {
+    auto it = customizationIndex.find(ts);
+    if (it != customizationIndex.end()) {
+        customizations.splice(customizations.begin(), customizations, it->second);
+        return customizations.front();
+    }
+    if ((int)customizations.size() >= maxCustomizations) {
+        customizationIndex.erase(customizations.back().ts);
+        customizations.splice(customizations.begin(), customizations, prev(customizations.end()));
+    } else {
+        customizations.emplace_front();
+    }
+    Customization& cust = customizations.front();
+    cust.ts = ts;
+    customizationIndex[ts] = customizations.begin();
+    cust.weight.resize(overlay.size());
+    cust.dirty.resize(overlay.size());
+    cust.pending.resize(overlay.size());
+    for (size_t l = 0; l < overlay.size(); ++l) {
+        cust.weight[l].assign(overlay[l].matrixSize, INT_MAX);
+        cust.dirty[l].assign(overlay[l].cells, 1);
+        cust.pending[l].assign(overlay[l].cells, 1);
+    }
+    return cust;
+}
+
+// 道路e的容量由oldCapacity變為newCapacity：對每個已客製化的ts，若可用與否改變，
+// 就把同時包含道路兩端的最底層分區標為需重算，並通知所有上層分區
+// (在更低層它是切邊，查詢和上層重算時直接讀取容量)
+void markOverlayDirty(int e, int oldCapacity, int newCapacity) {
+    int u = edgeU[e], v = edgeV[e];
+    size_t lowest = 0;
+    while (lowest < overlay.size() && overlay[lowest].cell[u] != overlay[lowest].cell[v]) ++lowest;
+    if (lowest == overlay.size()) return; // 最上層的切邊，不屬於任何邊界團
+    for (Customization& cust : customizations) {
+        if ((oldCapacity >= cust.ts) == (newCapacity >= cust.ts)) continue;
+        cust.dirty[lowest][overlay[lowest].cell[u]] = 1;
+        for (size_t l = lowest; l < overlay.size(); ++l) cust.pending[l][overlay[l].cell[u]] = 1;
+    }
+}
+
+bool overlaySearch(int src, int dst, int ts, vector<int>& path) {
+    searchStats[StatOverlay].searches++;
+    Customization& cust = customizeOverlay(ts);
+    int levels = overlay.size();
+    SearchContext& sc = searchContext[0];
+    sc.begin();
+    sc.set(src, 0, -1);
+    sc.push(0, src);
+    const ArcFilter usable = arcFilter(ts);
+
+    while (!sc.empty()) {
+        pair<int, int> top = sc.pop();
+        int d = top.first;
+        int u = top.second;
+        if (d > sc.dist(u)) continue;
+        searchStats[StatOverlay].settled++;
+        if (u == dst) break;
+        // 查詢層級：u和src、dst都不在同一分區的最高層；都在同一分區時(-1)直接走原圖
+        int l = levels - 1;
+        while (l >= 0 && (overlay[l].cell[u] == overlay[l].cell[src] || overlay[l].cell[u] == overlay[l].cell[dst])) --l;
+        if (l >= 0) {
+            const OverlayLevel& ov = overlay[l];
+            int c = ov.cell[u], first = ov.boundaryStart[c], k = ov.boundaryStart[c + 1] - first;
+            ensureCustomized(cust, l, c, ts);
+            const int* row = &cust.weight[l][ov.matrixStart[c] + (long long)ov.boundaryIndex[u] * k];
+            int via = -2 - (l * (V + 1) + u); // 前驅記為負值，表示經過第l層從u出發的邊界團
+            for (int j = 0; j < k; ++j) {
+                int v = ov.boundary[first + j];
+                if (row[j] != INT_MAX && v != u && d + row[j] < sc.dist(v)) {
+                    sc.set(v, d + row[j], via);
+                    sc.push(d + row[j], v);
+                }
+            }
+        }
+        usable.forEach(u, [&](int i) {
+            int v = adjTo[i];
+            if (l >= 0 && overlay[l].cell[v] == overlay[l].cell[u]) return; // 分區內部由邊界團代表
+            if (d + adjDistance[i] < sc.dist(v)) {
+                sc.set(v, d + adjDistance[i], adjEdge[i]);
+                sc.push(d + adjDistance[i], v);
+            }
+        });
+    }
+
+    path.clear();
+    if (sc.dist(dst) == INT_MAX) return false;
+
+    // 回溯時把邊界團展開成分區內的原始道路，展開的搜尋用第二個工作區
+    thread_local vector<int> segment;
+    for (int current = dst; current != src; ) {
+        int prev = sc.prevEdge[current];
+        if (prev >= 0) {
+            path.push_back(prev);
+            current = otherEnd(prev, current);
+            continue;
+        }
+        int l = (-2 - prev) / (V + 1), u = (-2 - prev) % (V + 1);
+        SearchContext& inner = searchContext[1];
+        cellSearch(inner, l, overlay[l].cell[u], u, ts, current);
+        segment.clear();
+        for (int v = current; v != u; v = otherEnd(inner.prevEdge[v], v)) segment.push_back(inner.prevEdge[v]);
+        path.insert(path.end(), segment.begin(), segment.end());
+        current = u;
+    }
+    reverse(path.begin(), path.end());
+    return true;
+}
+
+inline bool useBidirectional() {
+    return bidirectionalMinVertices >= 0 && V >= bidirectionalMinVertices;
+}
+
+// 查詢方式的優先順序：--crp的覆蓋圖、--landmarks的A*、--bidirectional的雙向搜尋、單向搜尋
+// 前三者都只在指定選項時使用，預設一律是單向搜尋
+bool searchPath(int src, int dst, int ts, vector<int>& path) {
+    if (!overlay.empty()) return overlaySearch(src, dst, ts, path); // 有覆蓋圖時在覆蓋圖上查詢
+    if (landmarks > 0) return altSearch(src, dst, ts, path); // 有地標時用A*
+    if (useBidirectional()) return bidirectionalSearch(src, dst, ts, path);
+    return pointToPointSearch(src, dst, ts, path);
+}
+
+// 推測重播(--speculate W)：每W道指令為一段，先在工作執行緒上平行執行這段指令預計會做的搜尋，記下每次搜尋碰到的頂點；
+// 再依序執行這段指令，需要搜尋時若同樣的查詢推測過、且碰到的頂點在推測之後都沒有相鄰道路的容量或空閒司機的改變，
+// 搜尋讀到的內容就和推測時相同，結果也必定相同，直接沿用；否則照常搜尋。輸出與逐道執行完全相同
+// 推測重播預測的一次查詢：找最近的司機(nearest)或點對點路線
+struct ReplayQuery {
+    bool nearest;
+    int src, dst, ts;
+};
+struct ReplayResult {
+    bool found; // 點對點查詢是否走得到
+    int location, dist; // 找最近司機的結果
+    vector<int> path;
+    vector<int> reads; // 搜尋碰到的頂點
+    unsigned since; // 開始搜尋時的編號：碰到的頂點在這個編號(含)之後被改動過，結果就作廢
+};
+struct ReplayStats {
+    long long windows = 0, speculated = 0; // 段數與推測的查詢數
+    long long reused = 0, conflicts = 0, unpredicted = 0; // 沿用、因碰到的頂點被改動而重新搜尋、沒有推測到的查詢數
+    double speculateMs = 0, commitMs = 0; // 推測與依序執行的總時間
+};
+int replayWindow = 0; // 每段的指令數，0為不推測
+unsigned replayEpoch = 0; // 目前這段的編號，推測之前加一
+vector<unsigned> touchedEpoch; // 各頂點最後一次有相鄰道路容量或空閒司機改變時的編號
+unsigned locationsEpoch = 0; // 有空閒司機的位置集合最後一次改變時的編號(以地標找司機時整個集合都是目標)
+vector<ReplayResult> replayResults;
+unordered_map<PathCacheKey, int, PathCacheKeyHash> replayNearest, replayPaths; // 查詢 -> replayResults的位置
+ReplayStats replayStats;
+
+inline void touchVertex(int v) {
+    if (!touchedEpoch.empty()) touchedEpoch[v] = replayEpoch;
+}
+// v有了第一位或少了最後一位空閒司機
+inline void touchLocation(int v) {
+    if (touchedEpoch.empty()) return;
+    touchedEpoch[v] = replayEpoch;
+    locationsEpoch = replayEpoch;
+}
+
+// 結果搜尋之後，碰到的頂點都沒有相鄰道路容量或空閒司機的改變：搜尋讀到的內容與現在相同，結果也必定相同
+bool stillValid(const ReplayResult& r, bool dependsOnLocations) {
+    if (dependsOnLocations && locationsEpoch >= r.since) return false;
+    for (int v : r.reads) {
+        if (touchedEpoch[v] >= r.since) return false;
+    }
+    return true;
+}
+
+// 取得推測過且仍然有效的結果；碰到的頂點被改動過就作廢，之後同樣的查詢照常搜尋
+const ReplayResult* speculated(bool nearest, int src, int dst, int ts) {
+    if (!overlay.empty()) return nullptr;
+    if (replayWindow <= 0) return nullptr;
+    auto& index = nearest ? replayNearest : replayPaths;
+    auto it = index.find(PathCacheKey{src, dst, ts});
+    if (it == index.end()) {
+        replayStats.unpredicted++;
+        return nullptr;
+    }
+    const ReplayResult& r = replayResults[it->second];
+    if (!stillValid(r, nearest && landmarks > 0)) {
+        index.erase(it);
+        replayStats.conflicts++;
+        return nullptr;
+    }
+    replayStats.reused++;
+    return &r;
+}
+
+bool shortestPath(int src, int dst, int ts, vector<int>& path) {
+    if (PathCacheEntry* hit = findCached(src, dst, ts)) {
+        path.assign(hit->edges.begin(), hit->edges.end());
+        return hit->found;
+    }
+    bool found;
+    if (const ReplayResult* r = speculated(false, src, dst, ts)) {
+        path.assign(r->path.begin(), r->path.end());
+        found = r->found;
+    } else {
+        found = searchPath(src, dst, ts, path);
+    }
+    if (pathCacheSize > 0) storeCached(src, dst, ts, found).edges.assign(path.begin(), path.end());
+    return found;
+}
+
+// 空閒司機的Voronoi分區：每個ts一份多源最短路徑標記，記錄每個頂點最近的有空閒司機位置
+// 標記依(距離, 位置編號)比較，與findNearestDriver同距離取編號小者的規則一致；
+// 司機被指派、釋放或道路容量改變時只修補受影響的部分，找最近司機只需查表
+struct DriverVoronoi {
+    vector<int> dist; // 到最近空閒司機位置的距離，無法到達為INT_MAX
+    vector<int> site; // 最近的有空閒司機位置，無法到達為-1
+    vector<int> parentEdge; // 往site方向的下一條道路，site本身和無法到達的頂點為-1
+};
+struct VoronoiStats {
+    long long builds = 0, lookups = 0;
+    long long repairs = 0, touched = 0; // 增量修補的次數與重新標記的頂點數
+};
+int maxVoronoi = 0; // 最多為幾種ts維護Voronoi分區(--voronoi)，0為每次都搜尋
+map<int, DriverVoronoi> voronoi;
+VoronoiStats voronoiStats;
+
+// 從堆中的種子往外擴張，(距離, 位置)較小的標記覆蓋較大的
+void growVoronoi(DriverVoronoi& lab, int ts, vector<pair<int, int>>& heap) {
+    const ArcFilter usable = arcFilter(ts);
+    while (!heap.empty()) {
+        pop_heap(heap.begin(), heap.end(), greater<pair<int, int>>());
+        int d = heap.back().first;
+        int u = heap.back().second;
+        heap.pop_back();
+        if (d > lab.dist[u]) continue;
+        voronoiStats.touched++;
+        usable.forEach(u, [&](int i) {
+            int v = adjTo[i];
+            int nd = d + adjDistance[i];
+            if (nd < lab.dist[v] || (nd == lab.dist[v] && lab.site[u] < lab.site[v])) {
+                lab.dist[v] = nd;
+                lab.site[v] = lab.site[u];
+                lab.parentEdge[v] = adjEdge[i];
+                heap.push_back(make_pair(nd, v)); // 只改善位置時距離相同，v會再被取出一次
+                push_heap(heap.begin(), heap.end(), greater<pair<int, int>>());
+            }
+        });
+    }
+}
+
+// 清除以root為根的子樹(經由parentEdge)的標記，再從子樹外仍有效的鄰居重新擴張
+void repairVoronoi(DriverVoronoi& lab, int ts, int root) {
+    thread_local vector<int> subtree;
+    thread_local vector<pair<int, int>> heap;
+    subtree.assign(1, root);
+    for (size_t head = 0; head < subtree.size(); ++head) {
+        int u = subtree[head];
+        for (int i = adjOffset[u]; i < adjOffset[u + 1]; ++i) {
+            if (lab.parentEdge[adjTo[i]] == adjEdge[i]) subtree.push_back(adjTo[i]); // 以u為父節點的頂點
+        }
+    }
+    for (int u : subtree) {
+        lab.dist[u] = INT_MAX;
+        lab.site[u] = -1;
+        lab.parentEdge[u] = -1;
+    }
+    const ArcFilter usable = arcFilter(ts);
+    heap.clear();
+    for (int u : subtree) {
+        usable.forEach(u, [&](int i) {
+            int v = adjTo[i];
+            if (lab.site[v] == -1) return;
+            int nd = lab.dist[v] + adjDistance[i];
+            if (nd < lab.dist[u] || (nd == lab.dist[u] && lab.site[v] < lab.site[u])) {
+                lab.dist[u] = nd;
+                lab.site[u] = lab.site[v];
+                lab.parentEdge[u] = adjEdge[i];
+            }
+        });
+        if (lab.site[u] != -1) heap.push_back(make_pair(lab.dist[u], u));
+    }
+    make_heap(heap.begin(), heap.end(), greater<pair<int, int>>());
+    voronoiStats.repairs++;
+    growVoronoi(lab, ts, heap);
+}
+
+// 取得ts的Voronoi分區，第一次用到時以所有有空閒司機的位置為源點建立；超過數量上限時傳回nullptr
+DriverVoronoi* driverVoronoi(int ts) {
+    auto it = voronoi.find(ts);
+    if (it != voronoi.end()) return &it->second;
+    if ((int)voronoi.size() >= maxVoronoi) return nullptr;
+    DriverVoronoi& lab = voronoi[ts];
+    lab.dist.assign(V + 1, INT_MAX);
+    lab.site.assign(V + 1, -1);
+    lab.parentEdge.assign(V + 1, -1);
+    thread_local vector<pair<int, int>> heap;
+    heap.clear();
+    for (int v : availableLocations) {
+        lab.dist[v] = 0;
+        lab.site[v] = v;
+        heap.push_back(make_pair(0, v));
+    }
+    make_heap(heap.begin(), heap.end(), greater<pair<int, int>>());
+    voronoiStats.builds++;
+    growVoronoi(lab, ts, heap);
+    return &lab;
+}
+
+// 頂點v有了第一位空閒司機：成為新的源點
+void addVoronoiSite(int v) {
+    thread_local vector<pair<int, int>> heap;
+    for (auto& entry : voronoi) {
+        DriverVoronoi& lab = entry.second;
+        lab.dist[v] = 0;
+        lab.site[v] = v;
+        lab.parentEdge[v] = -1;
+        heap.assign(1, make_pair(0, v));
+        voronoiStats.repairs++;
+        growVoronoi(lab, entry.first, heap);
+    }
+}
+
+// 頂點v最後一位空閒司機被指派：整個分區交給相鄰分區
+void removeVoronoiSite(int v) {
+    for (auto& entry : voronoi) repairVoronoi(entry.second, entry.first, v);
+}
+
+// 道路e對門檻介於新舊容量之間的ts改變了可用與否
+void updateVoronoiEdge(int e, int oldCapacity, int newCapacity) {
+    int low = min(oldCapacity, newCapacity), high = max(oldCapacity, newCapacity);
+    thread_local vector<pair<int, int>> heap;
+    for (auto it = voronoi.upper_bound(low); it != voronoi.end() && it->first <= high; ++it) {
+        DriverVoronoi& lab = it->second;
+        int ends[2] = {edgeU[e], edgeV[e]};
+        if (newCapacity < it->first) { // 道路被佔滿：經過它的子樹要改走別的路
+            for (int k = 0; k < 2; ++k) {
+                if (lab.parentEdge[ends[k]] == e) repairVoronoi(lab, it->first, ends[k]);
+            }
+            continue;
+        }
+        heap.clear(); // 道路空出：兩端可能經由它得到更近的司機
+        for (int k = 0; k < 2; ++k) {
+            int u = ends[k], v = ends[1 - k];
+            if (lab.site[u] == -1) continue;
+            int nd = lab.dist[u] + edgeDistance[e];
+            if (nd < lab.dist[v] || (nd == lab.dist[v] && lab.site[u] < lab.site[v])) {
+                lab.dist[v] = nd;
+                lab.site[v] = lab.site[u];
+                lab.parentEdge[v] = e;
+                heap.push_back(make_pair(nd, v));
+            }
+        }
+        if (heap.empty()) continue;
+        make_heap(heap.begin(), heap.end(), greater<pair<int, int>>());
+        voronoiStats.repairs++;
+        growVoronoi(lab, it->first, heap);
+    }
+}
+
+OrderHandle orderHandle(const Order& order) {
+    int slot = &order - orderPool.data();
+    return OrderHandle{slot, orderGeneration[slot]};
+}
+
+// handle仍指向同一張訂單時傳回訂單，槽位已被回收則傳回nullptr
+Order* resolveOrder(OrderHandle handle) {
+    return orderGeneration[handle.slot] == handle.generation ? &orderPool[handle.slot] : nullptr;
+}
+
+bool watchValid(const BlockWatch& w) {
+    Order* order = resolveOrder(w.order);
+    return order && (order->state & OrderBlocked) && order->blockEpoch == w.epoch;
+}
+
+// 清除blocked旗標，之前的登記全部失效
+void clearBlocked(Order& order) {
+    if (!(order.state & OrderBlocked)) return;
+    order.state &= ~OrderBlocked;
+    order.blockEpoch++;
+    liveWatchEntries -= order.watchCount;
+    order.watchCount = 0;
+    blockedOrders.erase(order.id);
+}
+
+// blocked的訂單移回ready，下次有訂單完成時重試
+void unblockOrder(Order& order) {
+    if (!(order.state & OrderBlocked)) return;
+    clearBlocked(order);
+    readyOrders.insert(order.id);
+}
+
+// 失效的登記比有效的多時整個清理一次，攤提後每筆登記O(1)
+void compactWatchers() {
+    if (watchEntries <= 2 * liveWatchEntries + 1024) return;
+    for (auto* lists : {&edgeWatchers, &vertexWatchers}) {
+        for (auto& list : *lists) list.erase(remove_if(list.begin(), list.end(), [](const BlockWatch& w) { return !watchValid(w); }), list.end());
+    }
+    watchEntries = liveWatchEntries;
+}
+
+// 道路e的容量增加：喚醒容量已經足夠的訂單
+void wakeEdgeWatchers(int e) {
+    if (edgeWatchers.empty()) return;
+    vector<BlockWatch>& list = edgeWatchers[e];
+    size_t kept = 0;
+    for (const BlockWatch& w : list) {
+        if (!watchValid(w)) continue;
+        if (edgeCapacity[e] >= w.ts) {
+            unblockOrder(orderPool[w.order.slot]);
+            wakeStats.wakes++;
+            continue;
+        }
+        list[kept++] = w;
+    }
+    watchEntries -= list.size() - kept;
+    list.resize(kept);
+}
+
+// 頂點v有了空閒司機：喚醒範圍包含v的訂單
+void wakeVertexWatchers(int v) {
+    if (vertexWatchers.empty()) return;
+    for (const BlockWatch& w : vertexWatchers[v]) {
+        if (!watchValid(w)) continue;
+        unblockOrder(orderPool[w.order.slot]);
+        wakeStats.wakes++;
+    }
+    watchEntries -= vertexWatchers[v].size();
+    vertexWatchers[v].clear();
+}
+
+// 道路e的容量已由oldCapacity變為newCapacity：更新依容量而定的位元組、快取、覆蓋圖、Voronoi與喚醒條件
+void capacityChanged(int e, int oldCapacity, int newCapacity) {
+    touchVertex(edgeU[e]);
+    touchVertex(edgeV[e]);
+    if (!overlay.empty()) markOverlayDirty(e, oldCapacity, newCapacity); // 通知覆蓋圖重算受影響的分區
+    // 只有門檻介於新舊容量之間的位元組需要翻轉、快取需要作廢
+    int low = min(oldCapacity, newCapacity), high = max(oldCapacity, newCapacity);
+    for (auto it = blockedArcs.upper_bound(low); it != blockedArcs.end() && it->first <= high; ++it) {
+        bool blocked = newCapacity < it->first;
+        for (int k = 0; k < 2; ++k) {
+            int i = edgeArcs[2 * e + k];
+            if (blocked) it->second[i >> 6] |= 1ULL << (i & 63);
+            else it->second[i >> 6] &= ~(1ULL << (i & 63));
+        }
+    }
+    if (newCapacity > oldCapacity) {
+        for (auto it = unblockEpoch.upper_bound(low); it != unblockEpoch.end() && it->first <= high; ++it) it->second++;
+    }
+    if (!voronoi.empty()) updateVoronoiEdge(e, oldCapacity, newCapacity); // 位元組已更新，修補時用新的可用狀態
+    if (newCapacity > oldCapacity) wakeEdgeWatchers(e);
+}
+
+void changeCapacity(int e, int delta) {
+    int oldCapacity = edgeCapacity[e];
+    edgeCapacity[e] += delta;
+    capacityChanged(e, oldCapacity, edgeCapacity[e]);
+}
+
+// 可由多個執行緒同時呼叫的預留：逐條以CAS扣除ts，遇到容量不足的道路就把已扣的加回去，整條路徑要嘛全扣要嘛不扣
+// 只改容量數值，依容量而定的結構由呼叫者事後以capacityChanged補上
+bool claimPath(const vector<int>& path, int ts) {
+    for (size_t k = 0; k < path.size(); ++k) {
+        int* capacity = &edgeCapacity[path[k]];
+        int current = __atomic_load_n(capacity, __ATOMIC_RELAXED);
+        do {
+            if (current < ts) { // 查詢之後被別的執行緒扣走了
+                for (size_t j = 0; j < k; ++j) __atomic_fetch_add(&edgeCapacity[path[j]], ts, __ATOMIC_RELAXED);
+                return false;
+            }
+        } while (!__atomic_compare_exchange_n(capacity, &current, current - ts, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    }
+    return true;
+}
+
+bool reservePath(const vector<int>& path, int ts) {
+    for (int e : path) {
+        if (edgeCapacity[e] < ts) return false; // 先檢查整條路徑的容量
+    }
+    for (int e : path) {
+        changeCapacity(e, -ts); // 預留容量
+    }
+    return true;
+}
+
+bool reserveTrafficSpace(int src, int dst, int ts, vector<int>& path) {
+    if (!shortestPath(src, dst, ts, path)) return false; // 如果沒有找到路徑，返回false
+    return reservePath(path, ts); // 成功預留交通空間
+}
+
+void releaseTrafficSpace(const vector<int>& path, int ts) {
+    for (int e : path) {
+        changeCapacity(e, ts); // 釋放預留的容量
+    }
+}
+
+void releaseTrafficSpace(const PathSpan& span, int ts) {
+    for (const int* e = pathArena.begin(span); e != pathArena.end(span); ++e) {
+        changeCapacity(*e, ts); // 釋放預留的容量
+    }
+}
+
+bool hasAvailableDriver(int v) {
+    return availableDrivers[v] > 0;
+}
+
+// 把司機d放進所在頂點的空閒串列
+void pushFreeDriver(int d) {
+    int v = driverAt[d];
+    driverState[d] = DriverAvailable;
+    driverOrder[d] = -1;
+    driverNext[d] = freeDriverHead[v];
+    freeDriverHead[v] = d;
+    if (availableDrivers[v]++ == 0) {
+        availableSlot[v] = availableLocations.size();
+        availableLocations.push_back(v);
+        touchLocation(v);
+        addVoronoiSite(v);
+        wakeVertexWatchers(v);
+    }
+}
+
+// 配置各頂點的司機表，讀入頂點數後、第一次新增司機前呼叫
+void initDrivers() {
+    if (freeDriverHead.size() == (size_t)V + 1) return;
+    freeDriverHead.assign(V + 1, -1);
+    availableDrivers.assign(V + 1, 0);
+    availableSlot.assign(V + 1, -1);
+}
+
+// 讀入PLACE行：在v新增count位空閒司機
+void addDrivers(int v, int count) {
+    initDrivers();
+    for (int k = 0; k < count; ++k) {
+        int d = driverAt.size();
+        driverAt.push_back(v);
+        driverState.push_back(DriverAvailable);
+        driverOrder.push_back(-1);
+        driverNext.push_back(-1);
+        pushFreeDriver(d);
+    }
+}
+
+// 從v的空閒串列取出一位司機指派給訂單，傳回司機編號
+int assignDriver(int v, int order) {
+    int d = freeDriverHead[v];
+    freeDriverHead[v] = driverNext[d];
+    if (--availableDrivers[v] == 0) { // 以最後一個元素填補空位
+        int last = availableLocations.back();
+        availableLocations[availableSlot[v]] = last;
+        availableSlot[last] = availableSlot[v];
+        availableLocations.pop_back();
+        availableSlot[v] = -1;
+        touchLocation(v);
+        removeVoronoiSite(v);
+    }
+    driverState[d] = DriverBusy;
+    driverOrder[d] = order;
+    return d;
+}
+
+// 忙碌中的司機不在任何空閒串列裡，移動只需改位置
+void moveDriver(int d, int v) {
+    driverAt[d] = v;
+}
+
+void releaseDriver(int d) {
+    pushFreeDriver(d);
+}
+
+// findNearestDriver的搜尋部分：只讀取圖、容量與司機表，推測重播時在工作執行緒上執行
+int nearestDriverSearch(int src, int ts, int& distToSrc) {
+    thread_local vector<int> targets;
+    targets.clear();
+    bool useAlt = landmarks > 0;
+    if (useAlt) {
+        if ((int)availableLocations.size() <= ALT_MAX_TARGETS) {
+            targets.assign(availableLocations.begin(), availableLocations.end());
+        } else {
+            useAlt = false;
+        }
+    }
+    auto bound = [&](int v) {
+        if (!useAlt) return 0;
+        int best = INT_MAX; // 沒有目標或全都不連通時為INT_MAX
+        for (int t : targets) best = min(best, landmarkBound(v, t));
+        return best;
+    };
+    SearchStats& stats = searchStats[useAlt ? StatAltNearestDriver : StatNearestDriver];
+    stats.searches++;
+    SearchContext& sc = searchContext[0];
+    sc.begin();
+    int bestLocation = -1; // 最佳司機位置
+    int bestDist = INT_MAX;
+    int h = bound(src);
+    if (h != INT_MAX) {
+        sc.set(src, 0, -1);
+        sc.potential[src] = h;
+        sc.push(h, src);
+    }
+    const ArcFilter usable = arcFilter(ts);
+
+    while (!sc.empty()) {
+        pair<int, int> top = sc.pop();
+        int u = top.second;
+        int d = sc.dist(u);
+        if (top.first - sc.potential[u] > d) continue;
+        if (top.first > bestDist) break; // 已經沒有同樣近的司機
+        stats.settled++;
+        if ((bestLocation == -1 || u < bestLocation) && hasAvailableDriver(u)) {
+            bestLocation = u;
+            bestDist = d;
+        }
+        usable.forEach(u, [&](int i) {
+            int v = adjTo[i];
+            int weight = adjDistance[i];
+            if (d + weight < sc.dist(v)) {
+                int hv = sc.dist(v) == INT_MAX ? bound(v) : sc.potential[v];
+                if (hv == INT_MAX) return;
+                sc.set(v, d + weight, adjEdge[i]);
+                sc.potential[v] = hv;
+                sc.push(d + weight + hv, v);
+            }
+        });
+    }
+
+    distToSrc = bestLocation == -1 ? INT_MAX : sc.dist(bestLocation); // 更新到src的距離
+    return bestLocation; // 返回最佳司機位置
+}
+
+int findNearestDriver(int src, int ts, int& distToSrc, vector<int>& pathToSrc) {
+    // 從取餐點出發做一次容量過濾的Dijkstra，最近的有空閒司機的頂點即為答案
+    // 同距離時取編號最小的位置，與依序比較各司機位置的結果一致；
+    // 佇列不一定依頂點編號取出同距離的元素，所以要把同距離的頂點都取完才停
+    // 有地標且有空閒司機的位置不多時，以到各位置下界的最小值作為A*的啟發函數
+    // 有Voronoi分區時直接查表
+    // 選定位置後另外查詢司機位置到src的點對點路線：同樣長度的路線可能不只一條，以src為根的搜尋樹
+    // 或Voronoi標記沿前驅走回的不一定是點對點查詢會選的那條，預留的路線要與逐一比較司機時相同
+    // 原本逐一從各司機位置搜尋時，同樣近的位置取編號小者，同樣長的路線取先從堆取出的前驅，也就是(距離, 頂點編號)較小者；
+    // 預設的查詢方式兩者都相同(點對點搜尋的前驅見preferEarlierPrev)，選用--landmarks、--bidirectional或--crp時路線可能不同
+    pathToSrc.clear();
+    int location;
+    DriverVoronoi* lab = maxVoronoi > 0 ? driverVoronoi(ts) : nullptr;
+    if (lab) {
+        voronoiStats.lookups++;
+        location = lab->site[src];
+        distToSrc = lab->dist[src];
+    } else if (const ReplayResult* r = speculated(true, src, -1, ts)) {
+        distToSrc = r->dist;
+        location = r->location;
+    } else {
+        location = nearestDriverSearch(src, ts, distToSrc);
+    }
+    if (location != -1) shortestPath(location, src, ts, pathToSrc);
+    return location;
+}
+
+void logNoWayHome() {
+    outputLogs.push_back(LogRecord{LogNoWayHome, 0, 0});
+}
+
+// 每張訂單只有一筆"from"紀錄：已經有就原地替換，否則添加在最後(串流模式也一樣，見runStream)
+// 常駐模式下先前的回應已經送出，改派司機時另外添加一筆
+void logOrderFrom(int id, int driverLocation) {
+    if (serving) {
+        outputLogs.push_back(LogRecord{LogOrderFrom, id, driverLocation});
+        return;
+    }
+    auto inserted = orderFromLog.emplace(id, outputLogs.size());
+    if (!inserted.second) {
+        outputLogs[inserted.first->second].value = driverLocation;
+        return;
+    }
+    outputLogs.push_back(LogRecord{LogOrderFrom, id, driverLocation});
+}
+
+void logOrderDistance(int id, int distance) {
+    outputLogs.push_back(LogRecord{LogOrderDistance, id, distance});
+}
+
+template <class Out>
+void writeLog(Out& out, const LogRecord& log) {
+    if (log.kind == LogNoWayHome) {
+        out.put("No Way Home\n", 12);
+        return;
+    }
+    out.put("Order ", 6);
+    out.putInt(log.order);
+    if (log.kind == LogOrderFrom) out.put(" from: ", 7);
+    else out.put(" distance: ", 11);
+    out.putInt(log.value);
+    out.put('\n');
+}
+
+void printLogs() {
+    OutputWriter out;
+    out.open(outputPath, asyncOutput);
+    for (const LogRecord& log : outputLogs) writeLog(out, log);
+    out.close();
+}
+
+// 依訂單編號找到槽位，不存在時傳回nullptr
+Order* findOrder(int id) {
+    auto it = orderIndex.find(id);
+    return it == orderIndex.end() ? nullptr : &orderPool[it->second];
+}
+
+// 取得訂單的槽位，不存在時配置一個已完成狀態的空槽位
+Order& acquireOrder(int id) {
+    auto it = orderIndex.find(id);
+    if (it != orderIndex.end()) return orderPool[it->second];
+    int slot;
+    if (!freeOrderSlots.empty()) {
+        slot = freeOrderSlots.back();
+        freeOrderSlots.pop_back();
+    } else {
+        slot = orderPool.size();
+        orderPool.emplace_back();
+        orderGeneration.push_back(0);
+    }
+    orderIndex[id] = slot;
+    Order& order = orderPool[slot];
+    order.id = id;
+    order.state = OrderCompleted;
+    order.watchCount = 0;
+    return order;
+}
+
+// 已完成的訂單歸還槽位
+void releaseOrder(Order& order) {
+    int slot = &order - orderPool.data();
+    orderIndex.erase(order.id);
+    orderGeneration[slot]++;
+    freeOrderSlots.push_back(slot);
+}
+
+void setWaiting(Order& order, bool waiting) {
+    if (waiting == bool(order.state & OrderWaiting)) return;
+    if (waiting) {
+        order.state |= OrderWaiting;
+        readyOrders.insert(order.id);
+    } else {
+        clearBlocked(order);
+        order.state &= ~OrderWaiting;
+        readyOrders.erase(order.id);
+    }
+}
+
+// 重試後仍在等待的訂單：重試時找司機和送達(以ts為目的地)都從order.src出發，
+// 若以容量ts走得到的範圍內沒有空閒司機也沒有目的地，下次重試一定同樣失敗；
+// 這時改為blocked，在範圍邊界容量不足的道路和範圍內的每個頂點登記喚醒條件
+void blockIfStuck(Order& order) {
+    int src = order.src, dst = order.ts;
+    if (src < 0 || src > V || dst < 0 || dst > V) return;
+    SearchContext& sc = searchContext[0];
+    sc.begin();
+    thread_local vector<int> stack, region, boundary;
+    stack.clear();
+    region.clear();
+    boundary.clear();
+    sc.set(src, 0, -1);
+    stack.push_back(src);
+    while (!stack.empty()) {
+        int u = stack.back();
+        stack.pop_back();
+        if (u == dst || hasAvailableDriver(u)) return; // 重試可能成功
+        region.push_back(u);
+        for (int i = adjOffset[u]; i < adjOffset[u + 1]; ++i) {
+            int v = adjTo[i];
+            if (sc.dist(v) != INT_MAX) continue;
+            if (edgeCapacity[adjEdge[i]] < order.ts) {
+                boundary.push_back(i);
+            } else {
+                sc.set(v, 0, adjEdge[i]);
+                stack.push_back(v);
+            }
+        }
+    }
+
+    if (edgeWatchers.empty()) {
+        edgeWatchers.resize(edgeCapacity.size());
+        vertexWatchers.resize(V + 1);
+    }
+    BlockWatch watch{orderHandle(order), order.blockEpoch, order.ts};
+    int count = 0;
+    for (int i : boundary) {
+        if (sc.dist(adjTo[i]) != INT_MAX) continue; // 另一端後來從別的路走到了，不是邊界
+        edgeWatchers[adjEdge[i]].push_back(watch);
+        count++;
+    }
+    for (int u : region) vertexWatchers[u].push_back(watch);
+    count += region.size();
+    order.state |= OrderBlocked;
+    order.watchCount = count;
+    watchEntries += count;
+    liveWatchEntries += count;
+    readyOrders.erase(order.id);
+    blockedOrders.insert(order.id);
+    wakeStats.blocks++;
+    compactWatchers();
+}
+
+// 訂單已選好司機位置與司機到取餐點的路徑(driverLocation為-1表示沒有)：預留交通空間並指派司機，失敗則等待
+// reserved表示路徑已經預留好(批次派單以claimPath預留)
+void placeOrder(int id, int src, int ts, int driverLocation, int distToSrc, const vector<int>& pathToSrc, bool reserved = false) {
+    Order& order = acquireOrder(id);
+    unblockOrder(order); // src與ts可能改變，原本的喚醒條件不再適用
+    if (driverLocation == -1 || !(reserved || reservePath(pathToSrc, ts))) { // 沒有可用司機，或無法沿搜尋得到的路徑預留交通空間
+        logNoWayHome(); // 輸出無法送達的信息
+        if (!(order.state & OrderActive)) { // 活躍中的訂單保留原本的司機與路徑
+            order.src = src;
+            order.ts = ts;
+            order.driverLocation = -1;
+            order.driver = -1;
+            order.distance = 0;
+            pathArena.release(order.pathToSrc);
+            pathArena.release(order.pathToDst);
+        }
+        setWaiting(order, true); // 將訂單添加到等待列表
+        return;
+    }
+
+    logOrderFrom(id, driverLocation); // 替換或添加訂單起始司機位置的日誌
+    order.src = src;
+    order.ts = ts;
+    order.driverLocation = driverLocation;
+    order.driver = assignDriver(driverLocation, id); // 指派該位置的一位空閒司機
+    order.distance = distToSrc;
+    pathArena.release(order.pathToSrc);
+    pathArena.release(order.pathToDst);
+    order.pathToSrc = pathArena.store(pathToSrc);
+    order.state |= OrderActive; // 等待旗標不變，由送達成功時清除
+    dispatchStats.placed++;
+    dispatchStats.deadhead += distToSrc;
+}
 
-// 定義訂單結構
-struct Order {
-    int id, src, ts, driverLocation, distance;
-    bool waiting; // 訂單的基本屬性，包括ID，起始點，交通空間，司機位置，總距離和等待狀態
-    vector<int> pathToSrc; // 記錄司機到取餐點的路徑
-    vector<int> pathToDst; // 記錄取餐點到目的地的路徑
-};
+void processOrder(int id, int src, int ts) {
+    int distToSrc;
+    thread_local vector<int> pathToSrc; // 重複使用的路徑緩衝區，穩定後不再配置記憶體
+    size_t mark = allocationMark();
+    int driverLocation = findNearestDriver(src, ts, distToSrc, pathToSrc); // 尋找最近的可用司機
+    countRouting(mark);
+    placeOrder(id, src, ts, driverLocation, distToSrc, pathToSrc);
+}
 
-// 定義司機結構
-struct Driver {
-    int location;
-    bool available; // 司機位置和可用性
-    bool operator==(const Driver& other) const {
-        return location == other.location && available == other.available;
+bool dropOrder(int id, int dst) {
+    Order* found = findOrder(id);
+    if (!found || found->state == OrderCompleted) return false; // 如果訂單不在活躍或等待中，返回false
+    Order& order = *found;
+    unblockOrder(order);
+    thread_local vector<int> pathToDst; // 重複使用的路徑緩衝區
+
+    size_t mark = allocationMark();
+    bool reserved = reserveTrafficSpace(order.src, dst, order.ts, pathToDst);
+    countRouting(mark);
+    if (!reserved) { // 如果無法預留從起始點到目的地的交通空間
+        logNoWayHome(); // 輸出無法送達的信息
+        setWaiting(order, true); // 訂單繼續等待
+        return false; // 返回false表示處理失敗
     }
-};
 
-// 全局變量定義
-vector<vector<Edge>> graph; // 圖的鄰接表表示
-map<int, vector<Driver>> driversAtLocation; // 各頂點的司機列表
-map<int, Order> activeOrders; // 活躍訂單列表
-map<int, Order> waitingOrders; // 等待中的訂單列表
-int V, E, D; // 頂點數，邊數，司機數
-vector<string> outputLogs; // 用於儲存最終輸出的日誌
+    pathArena.release(order.pathToDst);
+    order.pathToDst = pathArena.store(pathToDst); // 更新訂單的目的地路徑
+    order.state |= OrderActive;
+    setWaiting(order, false); // 訂單不再等待
 
-// 函數定義
-void addEdge(int s, int d, int dis, int t) {
-    graph[s].push_back(Edge(d, dis, t)); // 添加正向邊
-    graph[d].push_back(Edge(s, dis, t)); // 添加反向邊，因為是無向圖
+    int totalDistance = order.distance + pathDistance(pathToDst); // 已經累計的距離加上目的地路徑的距離
+    // 司機可能已因訂單完成而釋放，甚至改派給別的訂單，只移動仍在為這張訂單服務的司機
+    if (order.driver != -1 && driverOrder[order.driver] == id) moveDriver(order.driver, dst);
+    logOrderDistance(id, totalDistance); // 輸出訂單的總距離
+    //replaceLog("Order " + to_string(id) + " distance:", "Order " + to_string(id) + " distance: " + to_string(order.distance));
+    
+    return true; // 返回true表示處理成功
 }
 
-vector<int> dijkstra(int src, int ts) {
-    priority_queue<pair<int, int>, vector<pair<int, int>>, greater<pair<int, int>>> pq; // 最小堆實現Dijkstra算法
-    vector<int> dist(V + 1, INT_MAX); // 距離陣列，初始化為最大值
-    dist[src] = 0;
-    pq.push(make_pair(0, src));
+void completeOrder(int id) {
+    Order* found = findOrder(id);
+    if (!found || !(found->state & OrderActive)) return; // 如果訂單不在活躍中，直接返回
+    Order& order = *found; // 獲取訂單信息
+    unblockOrder(order);
 
-    while (!pq.empty()) {
-        int d = pq.top().first;
-        int u = pq.top().second;
-        pq.pop();
-        if (d > dist[u]) continue; // 當前點的距離如果大於已知最短距離則跳過
-        for (int i = 0; i < graph[u].size(); ++i) {
-            Edge &edge = graph[u][i];
-            int v = edge.to;
-            int weight = edge.distance;
-            if (dist[u] + weight < dist[v] && edge.capacity >= ts) { // 檢查容量並更新距離
-                dist[v] = dist[u] + weight;
-                pq.push(make_pair(dist[v], v));
-            }
-        }
+    releaseTrafficSpace(order.pathToSrc, order.ts); // 釋放司機到取餐點的路徑上的交通空間
+    releaseTrafficSpace(order.pathToDst, order.ts); // 釋放取餐點到目的地的路徑上的交通空間
+    pathArena.release(order.pathToSrc); // 交通空間已釋放，路徑不再需要
+    pathArena.release(order.pathToDst);
+
+    if (order.driver != -1 && driverOrder[order.driver] == id) releaseDriver(order.driver); // 司機在目前位置恢復空閒
+    order.state &= ~OrderActive;
+    if (order.state == OrderCompleted) releaseOrder(order); // 不在等待中就歸還槽位
+
+    // 依編號順序走過所有等待中的訂單：ready的實際重試；blocked的重試一定失敗，
+    // 找司機與送達各輸出一次無法送達，和實際重試的輸出相同
+    auto skipRetry = []() {
+        logNoWayHome();
+        logNoWayHome();
+        wakeStats.skipped++;
+    };
+    thread_local vector<int> retry; // 這次要重試的訂單
+    retry.assign(readyOrders.begin(), readyOrders.end());
+    auto blocked = blockedOrders.begin();
+    for (int waitingId : retry) {
+        for (; blocked != blockedOrders.end() && *blocked < waitingId; ++blocked) skipRetry();
+        Order& waiting = *findOrder(waitingId); // 重試的訂單都已存在，不會配置新槽位
+        wakeStats.retries++;
+        processOrder(waitingId, waiting.src, waiting.ts); // 處理每個等待中的訂單
+        dropOrder(waitingId, waiting.ts); // 嘗試完成每個等待中的訂單的送達
+        if (waiting.state & OrderWaiting) blockIfStuck(waiting); // 插入的編號在blocked之前，不會重複走到
     }
-    return dist;
+    for (; blocked != blockedOrders.end(); ++blocked) skipRetry();
 }
+// 工作竊取執行緒池(--threads)：每個執行緒有自己的工作佇列，從尾端取自己的工作，做完了就從別人的前端偷
+// 呼叫run的執行緒也算一個，編號0；工作只能讀取共用狀態，結果寫在各自的位置，合併時依工作編號所以結果固定
+struct WorkPool {
+    struct Queue {
+        mutex lock;
+        deque<int> tasks;
+    };
+    vector<unique_ptr<Queue>> queues;
+    vector<thread> workers;
+    function<void(int)> job;
+    atomic<int> remaining{0};
+    mutex lock;
+    condition_variable wake, done;
+    unsigned round = 0; // 每次run加一，喚醒等待中的工作執行緒
+    bool stopping = false;
 
-bool reserveTrafficSpace(int src, int dst, int ts, vector<int>& path) {
-    priority_queue<pair<int, int>, vector<pair<int, int>>, greater<pair<int, int>>> pq;
-    vector<int> dist(V + 1, INT_MAX); // 距離陣列
-    vector<int> prev(V + 1, -1); // 前驅節點陣列
-    dist[src] = 0;
-    pq.push(make_pair(0, src));
-
-    while (!pq.empty()) {
-        int d = pq.top().first;
-        int u = pq.top().second;
-        pq.pop();
-        if (d > dist[u]) continue;
-        for (int i = 0; i < graph[u].size(); ++i) {
-            Edge &edge = graph[u][i];
-            int v = edge.to;
-            int weight = edge.distance;
-            if (dist[u] + weight < dist[v] && edge.capacity >= ts) {
-                dist[v] = dist[u] + weight;
-                prev[v] = u;
-                pq.push(make_pair(dist[v], v));
-            }
-        }
-    }
-
-    if (dist[dst] == INT_MAX) return false; // 如果沒有找到路徑，返回false
-
-    int current = dst;
-    while (prev[current] != -1) {
-        path.push_back(current);
-        int u = prev[current];
-        for (int i = 0; i < graph[u].size(); ++i) {
-            Edge &edge = graph[u][i];
-            if (edge.to == current) {
-                if (edge.capacity < ts) return false; // 檢查容量是否足夠
-                edge.capacity -= ts; // 預留容量
-                edge.full = (edge.capacity == 0); // 更新邊的滿載標志
-                break;
+    int size() const { return queues.size(); }
+    void start(int threads) {
+        for (int k = 0; k < threads; ++k) queues.emplace_back(new Queue());
+        for (int k = 1; k < threads; ++k) workers.emplace_back([this, k]() { work(k); });
+    }
+    bool take(int self, int& task) {
+        for (int k = 0; k < size(); ++k) {
+            Queue& q = *queues[(self + k) % size()];
+            lock_guard<mutex> guard(q.lock);
+            if (q.tasks.empty()) continue;
+            if (k == 0) {
+                task = q.tasks.back();
+                q.tasks.pop_back();
+            } else {
+                task = q.tasks.front();
+                q.tasks.pop_front();
             }
+            return true;
         }
-        for (int i = 0; i < graph[current].size(); ++i) {
-            Edge &edge = graph[current][i];
-            if (edge.to == u) {
-                if (edge.capacity < ts) return false;
-                edge.capacity -= ts;
-                edge.full = (edge.capacity == 0);
-                break;
+        return false;
+    }
+    void drain(int self) {
+        int task;
+        while (take(self, task)) {
+            job(task);
+            if (--remaining == 0) {
+                lock_guard<mutex> guard(lock);
+                done.notify_all();
             }
         }
-        current = u;
     }
-    path.push_back(src);
-    reverse(path.begin(), path.end()); // 反轉路徑以獲得正確的方向
-    return true; // 成功預留交通空間
-}
-
-void releaseTrafficSpace(const vector<int>& path, int ts) {
-    for (size_t i = 1; i < path.size(); ++i) {
-        int u = path[i - 1];
-        int v = path[i];
-        for (int j = 0; j < graph[u].size(); ++j) {
-            Edge &edge = graph[u][j];
-            if (edge.to == v) {
-                edge.capacity += ts; // 釋放預留的容量
-                edge.full = false; // 更新邊的滿載標志
-                break;
+    void work(int self) {
+        unsigned seen = 0;
+        while (true) {
+            {
+                unique_lock<mutex> guard(lock);
+                wake.wait(guard, [&]() { return stopping || round != seen; });
+                if (stopping) return;
+                seen = round;
             }
+            drain(self);
         }
-        for (int j = 0; j < graph[v].size(); ++j) {
-            Edge &edge = graph[v][j];
-            if (edge.to == u) {
-                edge.capacity += ts;
-                edge.full = false;
-                break;
-            }
+    }
+    // 執行fn(0..tasks-1)，全部完成才傳回
+    void run(int tasks, const function<void(int)>& fn) {
+        if (size() <= 1 || tasks <= 1) {
+            for (int i = 0; i < tasks; ++i) fn(i);
+            return;
+        }
+        job = fn;
+        remaining = tasks;
+        for (int i = 0; i < tasks; ++i) { // 依序分給各佇列
+            Queue& q = *queues[i % size()];
+            lock_guard<mutex> guard(q.lock);
+            q.tasks.push_back(i);
+        }
+        {
+            lock_guard<mutex> guard(lock);
+            round++;
         }
+        wake.notify_all();
+        drain(0);
+        unique_lock<mutex> guard(lock);
+        done.wait(guard, [&]() { return remaining == 0; });
     }
-}
+    ~WorkPool() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& w : workers) w.join();
+    }
+};
+int workerThreads = 1; // --threads：派單時平行評估候選司機的執行緒數，每個執行緒各有一組V大小的搜尋工作區
+WorkPool workPool;
 
-int findNearestDriver(int src, int ts, int& distToSrc, vector<int>& pathToSrc) {
-    vector<int> dist = dijkstra(src, ts); // 使用Dijkstra算法找到從src到所有點的最短距離
-    int minDist = INT_MAX; // 最小距離初始設為無窮大
-    int bestLocation = -1; // 最佳司機位置
+// 從取餐點出發的容量過濾Dijkstra，由近到遠收集空閒司機的位置與距離，收集到limit位司機為止
+// 只讀取圖、容量與司機表，可以在工作執行緒上執行；統計累加在stats
+void nearestDriverSlots(int src, int ts, int limit, vector<pair<int, int>>& found, SearchStats& stats) {
+    stats.searches++;
+    found.clear();
+    SearchContext& sc = searchContext[0];
+    sc.begin();
+    sc.set(src, 0, -1);
+    sc.push(0, src);
+    const ArcFilter usable = arcFilter(ts);
+    int drivers = 0;
+    while (!sc.empty() && drivers < limit) {
+        pair<int, int> top = sc.pop();
+        int d = top.first;
+        int u = top.second;
+        if (d > sc.dist(u)) continue;
+        stats.settled++;
+        if (hasAvailableDriver(u)) {
+            found.push_back(make_pair(u, d));
+            drivers += availableDrivers[u];
+        }
+        usable.forEach(u, [&](int i) {
+            int v = adjTo[i];
+            int weight = adjDistance[i];
+            if (d + weight < sc.dist(v)) {
+                sc.set(v, d + weight, adjEdge[i]);
+                sc.push(d + weight, v);
+            }
+        });
+    }
+}
 
-    for (const auto& entry : driversAtLocation) { // 遍歷所有司機的位置
-        int location = entry.first;
-        for (const auto& driver : entry.second) { // 遍歷該位置的所有司機
-            if (driver.available) {
-                vector<int> path;
-                if (reserveTrafficSpace(driver.location, src, ts, path)) { // 嘗試從司機位置到src預留交通空間
-                    int totalDistance = 0;
-                    for (size_t i = 1; i < path.size(); ++i) { // 計算路徑總距離
-                        int u = path[i - 1];
-                        int v = path[i];
-                        for (int j = 0; j < graph[u].size(); ++j) {
-                            Edge &edge = graph[u][j];
-                            if (edge.to == v) {
-                                totalDistance += edge.distance; // 累加距離
-                                break;
-                            }
-                        }
-                    }
-                    if (totalDistance < minDist) {
-                        minDist = totalDistance; // 更新最小距離
-                        bestLocation = driver.location; // 更新最佳司機位置
-                        pathToSrc = path; // 更新路徑
-                    }
-                    releaseTrafficSpace(path, ts); // 釋放預留的交通空間
+// 匈牙利演算法(位勢法)：rows列cols行(rows <= cols)的成本矩陣cost[i * cols + j]，
+// 傳回每列指派的行，使成本總和最小，O(rows^2 * cols)
+vector<int> solveAssignment(const vector<long long>& cost, int rows, int cols) {
+    const long long INF = LLONG_MAX / 4;
+    vector<long long> u(rows + 1, 0), v(cols + 1, 0), minv(cols + 1);
+    vector<int> p(cols + 1, 0), way(cols + 1, 0); // p[j]為第j行指派到的列(1起算)，0為未指派
+    vector<char> used(cols + 1);
+    for (int i = 1; i <= rows; ++i) {
+        p[0] = i;
+        int j0 = 0;
+        fill(minv.begin(), minv.end(), INF);
+        fill(used.begin(), used.end(), false);
+        do { // 從第i列找一條到未指派行的最短增廣路徑
+            used[j0] = true;
+            int i0 = p[j0], j1 = 0;
+            long long delta = INF;
+            for (int j = 1; j <= cols; ++j) {
+                if (used[j]) continue;
+                long long reduced = cost[(size_t)(i0 - 1) * cols + j - 1] - u[i0] - v[j];
+                if (reduced < minv[j]) {
+                    minv[j] = reduced;
+                    way[j] = j0;
+                }
+                if (minv[j] < delta) {
+                    delta = minv[j];
+                    j1 = j;
+                }
+            }
+            for (int j = 0; j <= cols; ++j) {
+                if (used[j]) {
+                    u[p[j]] += delta;
+                    v[j] -= delta;
+                } else {
+                    minv[j] -= delta;
                 }
             }
+            j0 = j1;
+        } while (p[j0] != 0);
+        do { // 沿增廣路徑翻轉指派
+            int j1 = way[j0];
+            p[j0] = p[j1];
+            j0 = j1;
+        } while (j0 != 0);
+    }
+    vector<int> match(rows, -1);
+    for (int j = 1; j <= cols; ++j) {
+        if (p[j] != 0) match[p[j] - 1] = j - 1;
+    }
+    return match;
+}
+
+// 為一批訂單選司機位置，傳回各訂單的位置(-1為不指派)：先使指派的訂單數最多，再使空車距離總和最小
+// 每張訂單只考慮最近的batch.size()位空閒司機，足以讓整批都有司機可選；同一位置有幾位空閒司機就有幾行
+vector<int> planBatch(const vector<BatchRequest>& batch) {
+    const long long UNASSIGNED = 1000000000000LL; // 不指派的成本，大於任何可能的距離總和
+    const long long FORBIDDEN = 4 * UNASSIGNED; // 不在候選名單內的組合
+    int rows = batch.size();
+    vector<vector<pair<int, int>>> candidates(rows); // 各訂單的(位置, 距離)
+    vector<int> columns; // 各行代表的司機位置
+    unordered_map<int, int> firstColumn; // 位置 -> 第一行
+    for (const BatchRequest& request : batch) arcFilter(request.ts); // 封鎖位元組先在這裡建好，工作執行緒只讀取
+    if (workerThreads > 1 && workPool.size() == 0) workPool.start(workerThreads);
+    vector<SearchStats> stats(rows);
+    workPool.run(rows, [&](int i) { nearestDriverSlots(batch[i].src, batch[i].ts, rows, candidates[i], stats[i]); });
+    for (int i = 0; i < rows; ++i) {
+        searchStats[StatBatchCandidates].searches += stats[i].searches;
+        searchStats[StatBatchCandidates].settled += stats[i].settled;
+        for (const auto& c : candidates[i]) {
+            if (firstColumn.count(c.first)) continue;
+            firstColumn[c.first] = columns.size();
+            for (int k = 0; k < min(availableDrivers[c.first], rows); ++k) columns.push_back(c.first);
         }
     }
-    distToSrc = minDist; // 更新到src的距離
-    return bestLocation; // 返回最佳司機位置
+    int slots = columns.size();
+    int cols = slots + rows; // 每張訂單一個「不指派」的虛擬行，保證有解
+    vector<long long> cost((size_t)rows * cols, FORBIDDEN);
+    for (int i = 0; i < rows; ++i) {
+        for (const auto& c : candidates[i]) {
+            int first = firstColumn[c.first];
+            for (int j = first; j < slots && columns[j] == c.first; ++j) cost[(size_t)i * cols + j] = c.second;
+        }
+        for (int j = slots; j < cols; ++j) cost[(size_t)i * cols + j] = UNASSIGNED;
+    }
+    vector<int> match = solveAssignment(cost, rows, cols);
+    vector<int> locations(rows, -1);
+    for (int i = 0; i < rows; ++i) {
+        if (match[i] < slots && cost[(size_t)i * cols + match[i]] < UNASSIGNED) locations[i] = columns[match[i]];
+    }
+    return locations;
 }
 
-void replaceLog(const string& searchStr, const string& replaceStr) {
-    for (auto& log : outputLogs) { // 遍歷所有日誌
-        if (log.find(searchStr) != string::npos) {
-            log = replaceStr; // 如果找到相應日誌，則替換
-            return;
+// 工作執行緒上的點對點查詢：不經過快取與覆蓋圖，兩者查詢時會改動共用的狀態
+bool concurrentSearch(int src, int dst, int ts, vector<int>& path) {
+    if (landmarks > 0) return altSearch(src, dst, ts, path);
+    if (useBidirectional()) return bidirectionalSearch(src, dst, ts, path);
+    return pointToPointSearch(src, dst, ts, path);
+}
+
+// 同時預留(--concurrent-claims)：兩張訂單搶同一條道路最後的容量時由先扣到的取得，結果隨執行緒的快慢而不同，所以預設不用
+bool concurrentClaims = false;
+const int CLAIM_ATTEMPTS = 8; // 搶輸這麼多次就放棄，交給之後逐張處理，避免互相退讓的執行緒一直重來
+
+// 在工作執行緒上同時查詢各訂單從選定位置到取餐點的路線並以claimPath預留，預留時容量已被別的訂單扣走就重新查詢
+// 預留期間只改了容量數值，結束後依每條道路的淨變化補上capacityChanged(依道路編號順序，結果固定)
+void claimBatchRoutes(const vector<int>& locations, vector<vector<int>>& paths, vector<char>& claimed) {
+    int rows = pendingOrders.size();
+    vector<int> lost(rows, 0);
+    workPool.run(rows, [&](int k) {
+        const BatchRequest& request = pendingOrders[k];
+        if (locations[k] == -1) return;
+        liveCapacity = true;
+        for (int attempt = 0; attempt < CLAIM_ATTEMPTS; ++attempt) {
+            if (!concurrentSearch(locations[k], request.src, request.ts, paths[k])) break;
+            if (claimPath(paths[k], request.ts)) {
+                claimed[k] = 1;
+                break;
+            }
+            lost[k]++;
         }
+        liveCapacity = false;
+    });
+    vector<pair<int, int>> taken; // (道路, 扣除量)
+    for (int k = 0; k < rows; ++k) {
+        dispatchStats.lostClaims += lost[k];
+        if (!claimed[k]) continue;
+        dispatchStats.claimed++;
+        for (int e : paths[k]) taken.push_back(make_pair(e, pendingOrders[k].ts));
+    }
+    sort(taken.begin(), taken.end());
+    for (size_t i = 0; i < taken.size();) {
+        int e = taken[i].first, total = 0;
+        for (; i < taken.size() && taken[i].first == e; ++i) total += taken[i].second;
+        capacityChanged(e, edgeCapacity[e] + total, edgeCapacity[e]);
     }
-    outputLogs.push_back(replaceStr); // 如果沒找到，則添加新日誌
 }
 
-void processOrder(int id, int src, int ts) {
-    int distToSrc;
-    vector<int> pathToSrc;
-    int driverLocation = findNearestDriver(src, ts, distToSrc, pathToSrc); // 尋找最近的可用司機
-    if (driverLocation == -1) { // 如果沒有可用司機
-        outputLogs.push_back("No Way Home"); // 輸出無法送達的信息
-        waitingOrders[id] = (Order){id, src, ts, -1, 0, true, {}, {}}; // 將訂單添加到等待列表
+// 依到達順序指派收集中的訂單：路線依選定的位置重新查詢，位置已沒有空閒司機或走不到時改回逐張找最近的司機
+// --concurrent-claims且多執行緒時路線先在工作執行緒上同時查詢並預留(claimBatchRoutes)，指派時位置已沒有空閒司機就退還路線；
+// 否則依到達順序逐張查詢與預留，結果與執行緒數無關
+void flushBatch() {
+    if (pendingOrders.empty()) return;
+    dispatchStats.batches++;
+    size_t mark = allocationMark();
+    vector<int> locations = planBatch(pendingOrders);
+    countRouting(mark);
+    if (concurrentClaims && workPool.size() > 1) {
+        int rows = pendingOrders.size();
+        vector<vector<int>> paths(rows);
+        vector<char> claimed(rows, 0);
+        claimBatchRoutes(locations, paths, claimed);
+        for (int k = 0; k < rows; ++k) {
+            const BatchRequest& request = pendingOrders[k];
+            if (claimed[k] && hasAvailableDriver(locations[k])) {
+                dispatchStats.planned++;
+                placeOrder(request.id, request.src, request.ts, locations[k], pathDistance(paths[k]), paths[k], true);
+                continue;
+            }
+            if (claimed[k]) releaseTrafficSpace(paths[k], request.ts);
+            dispatchStats.fallbacks++;
+            processOrder(request.id, request.src, request.ts);
+        }
+        pendingOrders.clear();
         return;
     }
+    thread_local vector<int> pathToSrc;
+    for (size_t k = 0; k < pendingOrders.size(); ++k) {
+        const BatchRequest& request = pendingOrders[k];
+        int location = locations[k];
+        if (location != -1 && hasAvailableDriver(location) && shortestPath(location, request.src, request.ts, pathToSrc)) {
+            dispatchStats.planned++;
+            placeOrder(request.id, request.src, request.ts, location, pathDistance(pathToSrc), pathToSrc);
+        } else {
+            dispatchStats.fallbacks++;
+            processOrder(request.id, request.src, request.ts);
+        }
+    }
+    pendingOrders.clear();
+}
 
-    if (!reserveTrafficSpace(driverLocation, src, ts, pathToSrc)) { // 如果無法預留交通空間
-        outputLogs.push_back("No Way Home"); // 輸出無法送達的信息
-        waitingOrders[id] = (Order){id, src, ts, -1, 0, true, {}, {}}; // 將訂單添加到等待列表
-        return;
+// 處理Order指令：批次模式下先收集，滿一批才指派
+void submitOrder(int id, int src, int ts) {
+    if (batchSize <= 1) return processOrder(id, src, ts);
+    pendingOrders.push_back(BatchRequest{id, src, ts});
+    if ((int)pendingOrders.size() >= batchSize) flushBatch();
+}
+
+// 建圖後依圖的大小準備各種加速結構
+void prepareRouting() {
+    initDrivers(); // 沒有PLACE行時也要有各頂點的司機表
+    if (landmarkCount > 0) buildLandmarks();
+    if (useOverlay) buildOverlay();
+}
+
+// 預先解析的指令，處理時不必再碰文字
+enum CommandKind : char { CommandOrder, CommandDrop, CommandComplete, CommandOther };
+struct Command {
+    CommandKind kind;
+    int id, param1, param2;
+};
+vector<Command> commands;
+int parseThreads = max(1u, thread::hardware_concurrency()); // --parse-threads：解析EDGE與指令的執行緒數
+const long long PARALLEL_PARSE_BYTES = 1 << 20; // 小於此大小的區段不開執行緒
+struct StartupStats {
+    double read = 0, header = 0, edges = 0, build = 0, prepare = 0, commands = 0; // 各階段毫秒數
+};
+StartupStats startupStats;
+// 指令處理時間的分布：以2的次方分段、每段再等分16格，記憶體固定，誤差在1/16以內
+struct LatencyHistogram {
+    static const int SUB = 16;
+    long long counts[64 * SUB] = {};
+    long long total = 0, maxNs = 0;
+
+    static int bucket(long long ns) {
+        if (ns < SUB) return ns;
+        int msb = 63 - __builtin_clzll(ns);
+        int group = msb - 3;
+        return group * SUB + ((ns >> (msb - 4)) & (SUB - 1));
     }
+    void record(long long ns) {
+        if (ns < 0) ns = 0;
+        counts[bucket(ns)]++;
+        total++;
+        maxNs = max(maxNs, ns);
+    }
+    // 第q分位數所在格子的中間值
+    double percentile(double q) const {
+        long long rank = max(1LL, (long long)ceil(q * total)), seen = 0;
+        for (int i = 0; i < 64 * SUB; ++i) {
+            seen += counts[i];
+            if (seen < rank) continue;
+            if (i < SUB) return i;
+            int group = i / SUB;
+            long long width = 1LL << (group - 1);
+            return (double)((SUB + i % SUB) << (group - 1)) + width / 2.0;
+        }
+        return maxNs;
+    }
+};
+LatencyHistogram commandLatency;
 
-    replaceLog("Order " + to_string(id) + " from:", "Order " + to_string(id) + " from: " + to_string(driverLocation)); // 替換或添加訂單起始司機位置的日誌
-    activeOrders[id] = (Order){id, src, ts, driverLocation, distToSrc, false, pathToSrc, {}}; // 將訂單添加到活躍訂單列表
-    for (auto& driver : driversAtLocation[driverLocation]) { // 遍歷司機位置
-        if (driver.available) { // 找到可用司機
-            driver.available = false; // 將司機標記為忙碌
-            break;
+void reportStats() {
+    const LatencyHistogram& lat = commandLatency;
+    if (lat.total > 0) {
+        cerr << "command latency: " << lat.total << " commands, p50 " << lat.percentile(0.5) / 1000 << " us, p99 "
+             << lat.percentile(0.99) / 1000 << " us, p999 " << lat.percentile(0.999) / 1000 << " us, max "
+             << lat.maxNs / 1000.0 << " us" << endl;
+    }
+    const StartupStats& st = startupStats;
+    if (!streamMode) { // 串流模式邊讀邊處理，沒有分開的解析階段
+        cerr << "startup: read " << st.read << " ms, header " << st.header << " ms, parse edges " << st.edges
+             << " ms, build graph " << st.build << " ms, prepare routing " << st.prepare << " ms, parse commands "
+             << st.commands << " ms (" << parseThreads << " threads)" << endl;
+    }
+    const ReplayStats& rs = replayStats;
+    if (rs.windows > 0) {
+        long long lookups = rs.reused + rs.conflicts + rs.unpredicted;
+        cerr << "speculation: " << rs.windows << " windows, " << rs.speculated << " searches speculated in "
+             << rs.speculateMs << " ms, commit " << rs.commitMs << " ms; " << rs.reused << " of " << lookups
+             << " searches reused (" << (lookups ? 100.0 * rs.reused / lookups : 0) << "%), " << rs.conflicts
+             << " re-run after conflicts, " << rs.unpredicted << " not predicted" << endl;
+    }
+    for (int k = 0; k < SEARCH_KINDS; ++k) {
+        if (searchStats[k].searches == 0) continue;
+        cerr << searchKindNames[k] << ": " << searchStats[k].searches << " searches, " << searchStats[k].settled
+             << " settled (" << (double)searchStats[k].settled / searchStats[k].searches << " per search)" << endl;
+    }
+    cerr << "blocked-arc masks: " << blockedArcs.size() << endl;
+    const VoronoiStats& vs = voronoiStats;
+    if (vs.builds > 0) {
+        cerr << "voronoi: " << vs.builds << " builds, " << vs.lookups << " lookups, " << vs.repairs << " repairs, "
+             << vs.touched << " vertices relabeled" << endl;
+    }
+    if (pathArena.stored > 0) {
+        cerr << "path arena: " << pathArena.stored << " paths stored, " << pathArena.chunks.size() << " chunks, "
+             << pathArena.recycled << " recycled" << endl;
+    }
+    const DispatchStats& ds = dispatchStats;
+    if (ds.placed > 0) {
+        cerr << "dispatch: " << ds.placed << " orders placed, deadhead distance " << ds.deadhead;
+        if (ds.batches > 0) {
+            cerr << ", " << ds.batches << " batches, " << ds.planned << " planned, " << ds.fallbacks << " fell back";
+            if (ds.claimed + ds.lostClaims > 0) cerr << ", " << ds.claimed << " routes claimed concurrently, " << ds.lostClaims << " lost races";
         }
+        cerr << endl;
+    }
+    const WakeStats& ws = wakeStats;
+    if (ws.retries + ws.skipped > 0) {
+        cerr << "waiting orders: " << ws.retries << " retried, " << ws.skipped << " skipped as blocked, "
+             << ws.blocks << " blocked, " << ws.wakes << " woken" << endl;
+    }
+    const PathCacheStats& cs = pathCacheStats;
+    if (cs.lookups > 0) {
+        cerr << "path cache: " << cs.lookups << " lookups, " << cs.hits << " hits ("
+             << 100.0 * cs.hits / cs.lookups << "%), " << cs.blocked + cs.freed << " invalidated ("
+             << 100.0 * (cs.blocked + cs.freed) / cs.lookups << "%: " << cs.blocked << " by full roads, "
+             << cs.freed << " by freed roads)" << endl;
     }
 }
 
-bool dropOrder(int id, int dst) {
-    if (activeOrders.find(id) == activeOrders.end() && waitingOrders.find(id) == waitingOrders.end()) return false; // 如果訂單不在活躍或等待列表中，返回false
-    vector<int> pathToDst;
-    Order order = activeOrders.find(id) != activeOrders.end() ? activeOrders[id] : waitingOrders[id]; // 獲取訂單信息
-
-    if (!reserveTrafficSpace(order.src, dst, order.ts, pathToDst)) { // 如果無法預留從起始點到目的地的交通空間
-        outputLogs.push_back("No Way Home"); // 輸出無法送達的信息
-        order.waiting = true; // 訂單繼續等待
-        waitingOrders[id] = order; // 更新等待訂單信息
-        return false; // 返回false表示處理失敗
+enum BenchmarkKind { NoBenchmark, QueueBenchmark, VoronoiBenchmark, BatchBenchmark };
+BenchmarkKind benchmark = NoBenchmark; // --bench、--bench-voronoi、--bench-batch：執行效能比較而不處理輸入
+int benchmarkSide = 300; // --bench-size：測試格網的邊長
+
+void parseOptions(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--queue" && i + 1 < argc) { // 選擇優先佇列：heap、radix或dial
+            string kind = argv[++i];
+            if (kind == "heap") queueKind = HeapQueue;
+            else if (kind == "radix") queueKind = RadixQueue;
+            else if (kind == "dial") queueKind = DialQueue;
+            else {
+                cerr << "unknown queue: " << kind << endl;
+                exit(1);
+            }
+        } else if (arg == "--crp") { // 建立多層分區覆蓋圖
+            useOverlay = true;
+        } else if (arg == "--crp-cell-size" && i + 1 < argc) {
+            crpCellSize = max(2, atoi(argv[++i]));
+        } else if (arg == "--crp-customizations" && i + 1 < argc) { // 保留客製化結果的ts種類數上限
+            maxCustomizations = max(1, atoi(argv[++i]));
+        } else if (arg == "--bidirectional" && i + 1 < argc) { // 頂點數達到此值時用雙向搜尋，0為一律使用
+            bidirectionalMinVertices = max(0, atoi(argv[++i]));
+        } else if (arg == "--landmarks" && i + 1 < argc) { // 地標數量，0為不使用
+            landmarkCount = atoi(argv[++i]);
+        } else if (arg == "--arc-masks" && i + 1 < argc) { // 封鎖位元組的數量上限
+            maxArcMasks = atoi(argv[++i]);
+        } else if (arg == "--path-cache" && i + 1 < argc) { // 最短路徑快取的項目數上限
+            pathCacheSize = atoi(argv[++i]);
+        } else if (arg == "--batch" && i + 1 < argc) { // 批次派單的訂單數
+            batchSize = atoi(argv[++i]);
+        } else if (arg == "--shards") { // 已移除：分區執行緒各自派單時結果與逐道執行不同，平行搜尋改用推測重播
+            cerr << "--shards is no longer supported; use --speculate W --threads N to run searches in parallel" << endl;
+            exit(1);
+        } else if (arg == "--speculate" && i + 1 < argc) { // 推測重播每段的指令數
+            replayWindow = max(0, atoi(argv[++i]));
+        } else if (arg == "--threads" && i + 1 < argc) {
+            workerThreads = max(1, atoi(argv[++i]));
+        } else if (arg == "--concurrent-claims") { // 批次的路線在工作執行緒上同時預留
+            concurrentClaims = true;
+        } else if (arg == "--parse-threads" && i + 1 < argc) {
+            parseThreads = max(1, atoi(argv[++i]));
+        } else if (arg == "--input" && i + 1 < argc) {
+            inputPath = argv[++i];
+        } else if (arg == "--stream") {
+            streamMode = true;
+        } else if (arg == "--output" && i + 1 < argc) {
+            outputPath = argv[++i];
+        } else if (arg == "--async-output") {
+            asyncOutput = true;
+        } else if (arg == "--listen" && i + 1 < argc) {
+            listenPath = argv[++i];
+        } else if (arg == "--connect" && i + 1 < argc) {
+            connectPath = argv[++i];
+        } else if (arg == "--clients" && i + 1 < argc) {
+            clientConnections = max(1, atoi(argv[++i]));
+        } else if (arg == "--fold") {
+            foldResponses = true;
+        } else if (arg == "--stats") {
+            printStats = true;
+        } else if (arg == "--voronoi" && i + 1 < argc) { // 維護空閒司機Voronoi分區的ts種類上限
+            maxVoronoi = atoi(argv[++i]);
+        } else if (arg == "--bench") {
+            benchmark = QueueBenchmark;
+        } else if (arg == "--bench-voronoi") {
+            benchmark = VoronoiBenchmark;
+        } else if (arg == "--bench-batch") { // 每批的訂單數由--batch指定
+            benchmark = BatchBenchmark;
+        } else if (arg == "--bench-size" && i + 1 < argc) {
+            benchmarkSide = atoi(argv[++i]);
+        } else {
+            cerr << "unknown option: " << arg << endl;
+            exit(1);
+        }
+    }
+    if (!listenPath.empty() && (batchSize > 1 || streamMode || replayWindow > 0)) {
+        cerr << "--listen cannot be combined with --batch, --stream or --speculate" << endl;
+        exit(1);
+    }
+    if (replayWindow > 0 && (batchSize > 1 || streamMode)) {
+        cerr << "--speculate cannot be combined with --batch or --stream" << endl;
+        exit(1);
     }
+}
 
-    order.waiting = false; // 訂單不再等待
-    order.pathToDst = pathToDst; // 更新訂單的目的地路徑
-    activeOrders[id] = order; // 更新活躍訂單信息
-    waitingOrders.erase(id); // 從等待列表中刪除訂單
+// 產生測試用的圖：grid為四方格網；road為隨機刪去部分街道並加入少量長距離快速道路的格網，邊長較分散
+void generateBenchmarkGraph(bool road, int side, mt19937& rng) {
+    V = side * side;
+    uniform_int_distribution<int> street(1, road ? 1000 : 100);
+    uniform_int_distribution<int> percent(0, 99);
+    for (int r = 0; r < side; ++r) {
+        for (int c = 0; c < side; ++c) {
+            int u = r * side + c + 1;
+            if (c + 1 < side && !(road && percent(rng) < 25)) addEdge(u, u + 1, street(rng), 10);
+            if (r + 1 < side && !(road && percent(rng) < 25)) addEdge(u, u + side, street(rng), 10);
+        }
+    }
+    if (road) {
+        uniform_int_distribution<int> vertex(1, V);
+        uniform_int_distribution<int> highway(1000, 5000);
+        for (int i = 0; i < V / 100; ++i) addEdge(vertex(rng), vertex(rng), highway(rng), 10);
+    }
+    E = rawEdges.size();
+    buildGraph();
+}
 
-    int totalDistance = order.distance; // 從訂單信息中獲取已經累計的距離
-    for (size_t i = 1; i < pathToDst.size(); ++i) { // 遍歷目的地路徑
-        int u = pathToDst[i - 1];
-        int v = pathToDst[i];
-        for (int j = 0; j < graph[u].size(); ++j) { // 遍歷相鄰邊
-            Edge &edge = graph[u][j];
-            if (edge.to == v) { // 如果找到目的地路徑上的邊
-                totalDistance += edge.distance; // 累加距離
-                break;
+int runQueueBenchmark() {
+    const char* names[] = {"heap", "radix", "dial"};
+    mt19937 rng(12345);
+    for (int road = 0; road < 2; ++road) {
+        generateBenchmarkGraph(road, benchmarkSide, rng);
+        vector<int> sources;
+        for (int i = 0; i < 20; ++i) sources.push_back(rng() % V + 1);
+        cout << (road ? "road" : "grid") << " V=" << V << " E=" << E << " maxDistance=" << maxEdgeDistance << endl;
+        long long expected = -1, expectedRoutes = 0;
+        vector<int> path;
+        for (int kind = HeapQueue; kind <= DialQueue; ++kind) {
+            queueKind = (QueueKind)kind;
+            long long checksum = 0; // 各佇列算出的距離總和必須相同
+            auto start = chrono::steady_clock::now();
+            for (int src : sources) {
+                dijkstraSearch(src, 1);
+                for (int v = 1; v <= V; ++v) {
+                    if (searchContext[0].dist(v) != INT_MAX) checksum += searchContext[0].dist(v);
+                }
+            }
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            long long routes = 0; // 預設查詢方式選出的路線(依邊編號)也必須相同，不只是一樣長
+            for (size_t k = 0; k + 1 < sources.size(); ++k) {
+                if (!searchPath(sources[k], sources[k + 1], 1, path)) continue;
+                for (int e : path) routes = routes * 31 + e;
             }
+            if (expected == -1) {
+                expected = checksum;
+                expectedRoutes = routes;
+            }
+            cout << "  " << names[kind] << ": " << ms / sources.size() << " ms/search"
+                 << (checksum == expected ? "" : " (checksum mismatch)")
+                 << (routes == expectedRoutes ? "" : " (route mismatch)") << endl;
         }
     }
-    order.distance = totalDistance; // 更新訂單的總距離
-    order.src = dst; // 更新訂單的當前位置為目的地
-    for (auto& driver : driversAtLocation[order.driverLocation]) { // 遍歷司機位置
-        if (!driver.available) { // 如果司機忙碌
-            driver.location = dst; // 更新司機位置為目的地
-            driver.available = false; // 確保司機狀態為忙碌
-            driversAtLocation[dst].push_back(driver); // 將司機添加到新位置的司機列表
-            driversAtLocation[order.driverLocation].erase( // 從原位置的司機列表中移除司機
-                remove(driversAtLocation[order.driverLocation].begin(), driversAtLocation[order.driverLocation].end(), driver),
-                driversAtLocation[order.driverLocation].end());
-            break;
+    queueKind = HeapQueue;
+    return 0;
+}
+
+// 模擬司機流動：訂單不斷指派最近的司機並佔用路段，忙碌的司機數維持在一定比例，最早的訂單先完成；
+// 同一串操作分別以每次搜尋和Voronoi分區查表執行，比較總時間、查詢時間與修補成本
+int runVoronoiBenchmark() {
+    mt19937 rng(12345);
+    generateBenchmarkGraph(true, benchmarkSide, rng);
+    vector<int> initialCapacity = edgeCapacity;
+    vector<pair<int, int>> places; // (位置, 司機數)
+    for (int i = 0; i < max(1, V / 200); ++i) places.push_back(make_pair(rng() % V + 1, rng() % 3 + 1));
+    int drivers = 0;
+    for (const auto& p : places) drivers += p.second;
+    const int orders = 2000;
+    vector<pair<int, int>> requests; // (取餐點, ts)
+    for (int i = 0; i < orders; ++i) requests.push_back(make_pair(rng() % V + 1, rng() % 3 + 1));
+    cout << "road V=" << V << " E=" << E << " drivers=" << drivers << " at " << places.size() << " places" << endl;
+
+    for (int busyPercent : {10, 50, 90}) { // 司機忙碌比例，越高表示指派與釋放越頻繁地改變分區
+        long long expected = -1;
+        for (int useVoronoi = 0; useVoronoi < 2; ++useVoronoi) {
+            edgeCapacity = initialCapacity; // 還原容量與司機狀態
+            blockedArcs.clear();
+            voronoi.clear();
+            driverAt.clear(); driverState.clear(); driverOrder.clear(); driverNext.clear();
+            freeDriverHead.clear();
+            availableLocations.clear();
+            for (const auto& p : places) addDrivers(p.first, p.second);
+            maxVoronoi = useVoronoi ? 3 : 0;
+            voronoiStats = VoronoiStats();
+
+            struct Trip { int driver, ts; vector<int> path; };
+            list<Trip> busy;
+            vector<int> pathToSrc;
+            long long checksum = 0; // 兩種方式指派的位置與距離必須相同
+            double queryMs = 0;
+            auto start = chrono::steady_clock::now();
+            for (int i = 0; i < orders; ++i) {
+                int src = requests[i].first, ts = requests[i].second, dist;
+                auto queryStart = chrono::steady_clock::now();
+                int location = findNearestDriver(src, ts, dist, pathToSrc);
+                queryMs += chrono::duration<double, milli>(chrono::steady_clock::now() - queryStart).count();
+                if (location != -1 && reservePath(pathToSrc, ts)) {
+                    checksum = checksum * 31 + location * 7 + dist;
+                    busy.push_back(Trip{assignDriver(location, i), ts, pathToSrc});
+                }
+                while (!busy.empty() && (long long)busy.size() * 100 > (long long)drivers * busyPercent) {
+                    releaseTrafficSpace(busy.front().path, busy.front().ts);
+                    releaseDriver(busy.front().driver);
+                    busy.pop_front();
+                }
+            }
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            if (expected == -1) expected = checksum;
+            cout << "  busy " << busyPercent << "% " << (useVoronoi ? "voronoi" : "search") << ": " << ms / orders
+                 << " ms/order, query " << queryMs / orders << " ms";
+            if (useVoronoi) {
+                cout << ", " << voronoiStats.repairs << " repairs relabeling " << voronoiStats.touched << " vertices";
+            }
+            cout << (checksum == expected ? "" : " (checksum mismatch)") << endl;
         }
     }
-    outputLogs.push_back("Order " + to_string(id) + " distance: " + to_string(totalDistance)); // 輸出訂單的總距離
-    //replaceLog("Order " + to_string(id) + " distance:", "Order " + to_string(id) + " distance: " + to_string(order.distance));
-    
-    return true; // 返回true表示處理成功
+    maxVoronoi = 0;
+    return 0;
 }
 
-void completeOrder(int id) {
-    if (activeOrders.find(id) == activeOrders.end()) return; // 如果訂單不在活躍列表中，直接返回
-    Order &order = activeOrders[id]; // 獲取訂單信息
+// 比較逐張指派最近司機與批次指派：同一串訂單每batchSize張一組到達，每組之後最早的行程先結束，
+// 直到忙碌的司機數降回一定比例；比較處理速度、成功指派的訂單數與空車距離總和
+int runBatchBenchmark() {
+    mt19937 rng(12345);
+    generateBenchmarkGraph(true, benchmarkSide, rng);
+    vector<int> initialCapacity = edgeCapacity;
+    vector<pair<int, int>> places; // (位置, 司機數)
+    for (int i = 0; i < max(1, V / 200); ++i) places.push_back(make_pair(rng() % V + 1, rng() % 3 + 1));
+    int drivers = 0;
+    for (const auto& p : places) drivers += p.second;
+    const int orders = 2000;
+    int group = max(batchSize, 2);
+    vector<BatchRequest> requests;
+    for (int i = 0; i < orders; ++i) requests.push_back(BatchRequest{i, (int)(rng() % V + 1), (int)(rng() % 3 + 1)});
+    cout << "road V=" << V << " E=" << E << " drivers=" << drivers << " at " << places.size() << " places, batch "
+         << group << endl;
 
-    releaseTrafficSpace(order.pathToSrc, order.ts); // 釋放司機到取餐點的路徑上的交通空間
-    releaseTrafficSpace(order.pathToDst, order.ts); // 釋放取餐點到目的地的路徑上的交通空間
+    for (int busyPercent : {50, 90}) {
+        for (int batched = 0; batched < 2; ++batched) {
+            edgeCapacity = initialCapacity; // 還原容量與司機狀態
+            blockedArcs.clear();
+            pathCache.clear();
+            pathCacheIndex.clear();
+            driverAt.clear(); driverState.clear(); driverOrder.clear(); driverNext.clear();
+            freeDriverHead.clear();
+            availableLocations.clear();
+            for (const auto& p : places) addDrivers(p.first, p.second);
 
-    for (auto& driver : driversAtLocation[order.src]) { // 遍歷司機位置
-        if (!driver.available) { // 如果司機忙碌
-            driver.available = true; // 將司機標記為可用
-            break;
+            struct Trip { int driver, ts; vector<int> path; };
+            list<Trip> busy;
+            vector<int> pathToSrc;
+            int placed = 0;
+            long long deadhead = 0;
+            auto start = chrono::steady_clock::now();
+            for (int first = 0; first < orders; first += group) {
+                vector<BatchRequest> batch(requests.begin() + first, requests.begin() + min(orders, first + group));
+                vector<int> locations;
+                if (batched) locations = planBatch(batch);
+                for (size_t k = 0; k < batch.size(); ++k) {
+                    int src = batch[k].src, ts = batch[k].ts, location, dist;
+                    if (batched && locations[k] != -1 && hasAvailableDriver(locations[k])
+                        && shortestPath(locations[k], src, ts, pathToSrc)) {
+                        location = locations[k];
+                        dist = pathDistance(pathToSrc);
+                    } else {
+                        location = findNearestDriver(src, ts, dist, pathToSrc);
+                    }
+                    if (location != -1 && reservePath(pathToSrc, ts)) {
+                        placed++;
+                        deadhead += dist;
+                        busy.push_back(Trip{assignDriver(location, batch[k].id), ts, pathToSrc});
+                    }
+                }
+                while (!busy.empty() && (long long)busy.size() * 100 > (long long)drivers * busyPercent) {
+                    releaseTrafficSpace(busy.front().path, busy.front().ts);
+                    releaseDriver(busy.front().driver);
+                    busy.pop_front();
+                }
+            }
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            cout << "  busy " << busyPercent << "% " << (batched ? "batch" : "greedy") << ": " << orders * 1000.0 / ms
+                 << " orders/s, " << placed << " placed, " << orders - placed << " no way home, deadhead " << deadhead
+                 << " (" << (placed ? (double)deadhead / placed : 0) << " per order)" << endl;
         }
     }
-    activeOrders.erase(id); // 從活躍訂單列表中刪除訂單
+    return 0;
+}
 
-    vector<int> waitingOrderIds; // 儲存等待中的訂單ID
-    for (const auto& entry : waitingOrders) { // 遍歷等待中的訂單
-        waitingOrderIds.push_back(entry.first);
+// 輸入檔案：一般檔案以mmap映射，管線等無法映射的輸入整個讀進記憶體
+struct InputFile {
+    const char* data = nullptr;
+    size_t size = 0;
+    void* mapped = nullptr;
+    vector<char> buffer;
+
+    bool open(int fd) {
+        struct stat info;
+        if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+            size = info.st_size;
+            mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                madvise(mapped, size, MADV_SEQUENTIAL);
+                data = (const char*)mapped;
+                return true;
+            }
+            mapped = nullptr;
+        }
+        char chunk[1 << 16];
+        while (true) {
+            ssize_t n = ::read(fd, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) return false;
+            if (n == 0) break;
+            buffer.insert(buffer.end(), chunk, chunk + n);
+        }
+        data = buffer.data();
+        size = buffer.size();
+        return true;
     }
-    sort(waitingOrderIds.begin(), waitingOrderIds.end()); // 對等待訂單ID進行排序
-    for (int waitingId : waitingOrderIds) { // 遍歷排序後的等待訂單ID
-        processOrder(waitingId, waitingOrders[waitingId].src, waitingOrders[waitingId].ts); // 處理每個等待中的訂單
-        dropOrder(waitingId, waitingOrders[waitingId].ts); // 嘗試完成每個等待中的訂單的送達
+    ~InputFile() {
+        if (mapped) munmap(mapped, size);
     }
+};
+
+// 手寫的欄位掃描：跳過空白後讀一個字或整數，p停在欄位之後
+inline void skipBlanks(const char*& p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+}
+// 讀不到整數時傳回0
+inline int scanInt(const char*& p, const char* end) {
+    skipBlanks(p, end);
+    bool negative = p < end && *p == '-';
+    if (negative || (p < end && *p == '+')) ++p;
+    unsigned value = 0;
+    while (p < end && *p >= '0' && *p <= '9') value = value * 10 + (*p++ - '0');
+    return negative ? -(int)value : (int)value;
+}
+// 跳過一個字
+inline void skipWord(const char*& p, const char* end) {
+    skipBlanks(p, end);
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r') ++p;
+}
+// 讀一個字，依字面決定指令種類
+inline CommandKind scanCommand(const char*& p, const char* end) {
+    skipBlanks(p, end);
+    const char* start = p;
+    skipWord(p, end);
+    auto is = [&](const char* word) { return strlen(word) == (size_t)(p - start) && memcmp(start, word, p - start) == 0; };
+    if (is("Order")) return CommandOrder;
+    if (is("Drop")) return CommandDrop;
+    if (is("Complete")) return CommandComplete;
+    return CommandOther;
+}
+// 傳回下一行的開頭，lineEnd為本行結尾(不含換行)
+inline const char* nextLine(const char* p, const char* end, const char*& lineEnd) {
+    const char* newline = (const char*)memchr(p, '\n', end - p);
+    lineEnd = newline ? newline : end;
+    return newline ? newline + 1 : end;
+}
+
+// 以threads個執行緒執行fn(0..threads-1)，第0段在目前的執行緒
+template <class Fn>
+void parallelFor(int threads, Fn fn) {
+    vector<thread> workers;
+    for (int k = 1; k < threads; ++k) workers.emplace_back(fn, k);
+    fn(0);
+    for (auto& w : workers) w.join();
+}
+
+// 從begin開始的count行依位元組切成多段平行處理，fn(行號, 行首, 行尾)；傳回這些行之後的位置
+// 第一遍各段數換行，前綴和得到每段第一行的行號；第二遍每段處理行首落在段內的行
+template <class Fn>
+const char* forEachLine(const char* begin, const char* end, long long count, Fn fn) {
+    if (count <= 0) return begin;
+    int threads = end - begin < PARALLEL_PARSE_BYTES ? 1 : parseThreads;
+    vector<const char*> cut(threads + 1);
+    for (int k = 0; k <= threads; ++k) cut[k] = begin + (end - begin) * k / threads;
+    vector<long long> newlines(threads + 1, 0); // newlines[k]為第k段之前的換行數
+    parallelFor(threads, [&](int k) { newlines[k + 1] = count_if(cut[k], cut[k + 1], [](char c) { return c == '\n'; }); });
+    for (int k = 0; k < threads; ++k) newlines[k + 1] += newlines[k];
+    parallelFor(threads, [&](int k) {
+        const char* p = cut[k];
+        long long line = newlines[k];
+        if (k > 0 && p[-1] != '\n') { // 段首在行中間，這一行屬於前一段
+            const char* lineEnd;
+            p = nextLine(p, end, lineEnd);
+            if (lineEnd == end) return;
+            line++;
+        }
+        while (p < cut[k + 1] && line < count) {
+            const char* lineEnd;
+            const char* next = nextLine(p, end, lineEnd);
+            fn(line, p, lineEnd);
+            p = next;
+            line++;
+        }
+    });
+    // 第count個換行之後即為下一段的開頭
+    int k = 0;
+    while (k < threads && newlines[k + 1] < count) ++k;
+    if (k == threads) return end; // 最後一行沒有換行或行數不足
+    const char* p = cut[k];
+    for (long long line = newlines[k]; line < count; ++line) p = (const char*)memchr(p, '\n', cut[k + 1] - p) + 1;
+    return p;
 }
-#if Mode
-int main() {
-    ifstream file("input.csv");
-    string line;
 
-    getline(file, line);
-    stringstream ss(line);
-    ss >> V >> E >> D;
+Command parseCommand(const char* line, const char* lineEnd) {
+    Command command;
+    command.kind = scanCommand(line, lineEnd);
+    command.id = scanInt(line, lineEnd);
+    command.param1 = scanInt(line, lineEnd);
+    command.param2 = scanInt(line, lineEnd);
+    return command;
+}
 
-    graph.resize(V + 1);
+// 讀入整份輸入並建圖：第一行為頂點數、邊數、司機數，接著D行PLACE、E行EDGE、一行空行、指令數與指令
+void loadInput(const InputFile& input) {
+    const char* p = input.data;
+    const char* end = input.data + input.size;
+    const char* lineEnd;
+    auto time = chrono::steady_clock::now();
+    auto lap = [&time]() {
+        auto now = chrono::steady_clock::now();
+        double ms = chrono::duration<double, milli>(now - time).count();
+        time = now;
+        return ms;
+    };
 
-    for (int i = 0; i < D; i++) {
-        getline(file, line);
-        stringstream ss(line);
-        string place;
-        int v, c;
-        ss >> place >> v >> c;
+    const char* line = p;
+    p = nextLine(p, end, lineEnd);
+    V = scanInt(line, lineEnd);
+    E = scanInt(line, lineEnd);
+    D = scanInt(line, lineEnd);
+    for (int i = 0; i < D; i++) { // 司機位置依序加入，司機編號與讀入順序一致
+        line = p;
+        p = nextLine(p, end, lineEnd);
+        skipWord(line, lineEnd); // PLACE
+        int v = scanInt(line, lineEnd);
+        int c = scanInt(line, lineEnd);
         if (c > 0) {
-            driversAtLocation[v].resize(c, (Driver){v, true});
+            addDrivers(v, c);
         }
     }
+    startupStats.header = lap();
 
-    for (int i = 0; E > 0 && i < E; i++) {
-        getline(file, line);
-        stringstream ss(line);
-        string edge;
-        int s, d, dis, t;
-        ss >> edge >> s >> d >> dis >> t;
-        addEdge(s, d, dis, t);
-    }
+    int edges = E > 0 ? E : 0;
+    edgeU.resize(edges);
+    edgeV.resize(edges);
+    edgeDistance.resize(edges);
+    edgeCapacity.resize(edges);
+    p = forEachLine(p, end, edges, [](long long i, const char* line, const char* lineEnd) {
+        skipWord(line, lineEnd); // EDGE
+        edgeU[i] = scanInt(line, lineEnd); // 依行號直接寫入道路表，道路編號與讀入順序一致
+        edgeV[i] = scanInt(line, lineEnd);
+        edgeDistance[i] = scanInt(line, lineEnd);
+        edgeCapacity[i] = scanInt(line, lineEnd);
+    });
+    startupStats.edges = lap();
+    buildAdjacency(); // 讀完所有邊後建立CSR
+    startupStats.build = lap();
+    prepareRouting();
+    startupStats.prepare = lap();
+
+    p = nextLine(p, end, lineEnd); // 跳過空行
+    line = p;
+    p = nextLine(p, end, lineEnd);
+    int C = scanInt(line, lineEnd);
+    commands.assign(C > 0 ? C : 0, Command{CommandOther, 0, 0, 0});
+    forEachLine(p, end, C, [](long long i, const char* line, const char* lineEnd) {
+        commands[i] = parseCommand(line, lineEnd);
+    });
+    startupStats.commands = lap();
+}
 
-    getline(file, line);
+// 執行一道指令並記錄處理時間
+void runCommand(const Command& command) {
+    auto start = chrono::steady_clock::now();
+    if (command.kind == CommandOrder) {
+        submitOrder(command.id, command.param1, command.param2);
+    } else {
+        flushBatch(); // 其他指令可能用到收集中的訂單，先指派
+        if (command.kind == CommandDrop) {
+            dropOrder(command.id, command.param1);
+        } else if (command.kind == CommandComplete) {
+            completeOrder(command.id);
+        }
+    }
+    commandLatency.record(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+}
 
-    getline(file, line);
-    stringstream ss2(line);
-    int C;
-    ss2 >> C;
+const int REPLAY_MAX_RETRIES = 256; // 每段為Complete推測重試的等待訂單數上限
 
-    for (int i = 0; i < C; i++) {
-        getline(file, line);
-        stringstream ss(line);
-        string command;
-        int id, param1, param2;
-        ss >> command >> id;
-        if (command == "Order") {
-            ss >> param1 >> param2;
-            processOrder(id, param1, param2);
-        } else if (command == "Drop") {
-            ss >> param1;
-            dropOrder(id, param1);
-        } else if (command == "Complete") {
-            completeOrder(id);
+// 預測一道指令會做的搜尋，逐一交給add：Order找最近的司機；Drop從訂單的取餐點到目的地；
+// Complete重試目前ready的訂單(找司機，再以ts為目的地送達)，連同之前重試過的retried張最多REPLAY_MAX_RETRIES張。
+// 訂單的取餐點與ts取自目前的狀態，placed(之前預測過、尚未執行的Order)優先
+template <class F>
+void predictCommand(const Command& command, unordered_map<int, pair<int, int>>& placed, int& retried, F&& add) {
+    auto valid = [](int v) { return v >= 0 && v <= V; };
+    auto query = [&](bool nearest, int src, int dst, int ts) {
+        if (!valid(src) || (!nearest && !valid(dst))) return;
+        if (nearest ? maxVoronoi > 0 : !overlay.empty()) return; // 這兩種情況不經過搜尋，不推測
+        add(ReplayQuery{nearest, src, dst, ts});
+    };
+    auto orderOf = [&](int id, int& src, int& ts) {
+        auto it = placed.find(id);
+        if (it != placed.end()) {
+            src = it->second.first;
+            ts = it->second.second;
+            return true;
+        }
+        Order* order = findOrder(id);
+        if (!order || order->state == OrderCompleted) return false;
+        src = order->src;
+        ts = order->ts;
+        return true;
+    };
+    int src, ts;
+    if (command.kind == CommandOrder) {
+        query(true, command.param1, -1, command.param2);
+        placed[command.id] = make_pair(command.param1, command.param2);
+    } else if (command.kind == CommandDrop) {
+        if (orderOf(command.id, src, ts)) query(false, src, command.param1, ts);
+    } else if (command.kind == CommandComplete) {
+        for (int id : readyOrders) {
+            if (retried++ >= REPLAY_MAX_RETRIES) break;
+            if (!orderOf(id, src, ts)) continue;
+            query(true, src, -1, ts);
+            query(false, src, ts, ts);
         }
     }
+}
 
-    // for (const auto& entry : activeOrders) {
-    //     int id = entry.first;
-    //     const Order& order = entry.second;
-    //     replaceLog("Order " + to_string(id) + " from:", "Order " + to_string(id) + " from: " + to_string(order.driverLocation));
-    //     replaceLog("Order " + to_string(id) + " distance:", "Order " + to_string(id) + " distance: " + to_string(order.distance));
-    // }
+// 預測[first, last)的指令會做的搜尋，同樣的查詢只推測一次；訂單的狀態取自這段之前，這段之內的Order優先
+void predictQueries(size_t first, size_t last, vector<ReplayQuery>& queries) {
+    queries.clear();
+    replayNearest.clear();
+    replayPaths.clear();
+    unordered_map<int, pair<int, int>> placed; // 這段之內Order過的訂單 -> (src, ts)
+    int retried = 0;
+    for (size_t i = first; i < last; ++i) {
+        predictCommand(commands[i], placed, retried, [&](const ReplayQuery& query) {
+            auto& index = query.nearest ? replayNearest : replayPaths;
+            if (index.emplace(PathCacheKey{query.src, query.dst, query.ts}, queries.size()).second) queries.push_back(query);
+        });
+    }
+}
 
-    for (const auto& log : outputLogs) {
-        cout << log << endl;
+// 在工作執行緒上執行一次推測的查詢，記下碰到的頂點；找到最近的司機時接著查詢司機位置到取餐點的路線，結果放在route
+// since為開始推測時的編號，之後的改動都標上不小於它的編號
+void speculate(const ReplayQuery& query, ReplayResult& result, ReplayResult& route, unsigned since) {
+    result.since = route.since = since;
+    result.reads.clear();
+    searchContext[0].trace = searchContext[1].trace = &result.reads;
+    if (query.nearest) result.location = nearestDriverSearch(query.src, query.ts, result.dist);
+    else result.found = searchPath(query.src, query.dst, query.ts, result.path);
+    route.reads.clear();
+    searchContext[0].trace = searchContext[1].trace = &route.reads;
+    if (query.nearest && result.location != -1 && overlay.empty()) {
+        route.found = searchPath(result.location, query.src, query.ts, route.path);
     }
+    searchContext[0].trace = searchContext[1].trace = nullptr;
+}
 
-    file.close();
-    return 0;
+// 推測重播：每段先平行推測，再依序執行；推測時只讀取狀態，依序執行時才改動，兩者不會同時進行
+void replayCommands() {
+    touchedEpoch.assign(V + 1, 0);
+    if (workerThreads > 1 && workPool.size() == 0) workPool.start(workerThreads);
+    vector<ReplayQuery> queries;
+    SearchStats saved[SEARCH_KINDS];
+    for (size_t first = 0; first < commands.size(); first += replayWindow) {
+        size_t last = min(commands.size(), first + replayWindow);
+        auto start = chrono::steady_clock::now();
+        predictQueries(first, last, queries);
+        for (const ReplayQuery& query : queries) arcFilter(query.ts); // 封鎖位元組先在這裡建好，工作執行緒只讀取
+        size_t n = queries.size(); // 第i個查詢的結果在replayResults[i]，接著查詢的路線在replayResults[n + i]
+        if (replayResults.size() < 2 * n) replayResults.resize(2 * n);
+        replayEpoch++; // 這段執行時的改動都標上新的編號
+        copy(searchStats, searchStats + SEARCH_KINDS, saved); // 推測的搜尋不計入各種搜尋的統計
+        workPool.run(n, [&](int i) { speculate(queries[i], replayResults[i], replayResults[n + i], replayEpoch); });
+        copy(saved, saved + SEARCH_KINDS, searchStats);
+        for (size_t i = 0; i < n; ++i) {
+            const ReplayQuery& query = queries[i];
+            int location = replayResults[i].location;
+            if (query.nearest && location != -1 && overlay.empty()) {
+                replayPaths.emplace(PathCacheKey{location, query.src, query.ts}, n + i);
+            }
+        }
+        auto middle = chrono::steady_clock::now();
+        for (size_t i = first; i < last; ++i) runCommand(commands[i]);
+        auto end = chrono::steady_clock::now();
+        replayStats.windows++;
+        replayStats.speculated += queries.size();
+        replayStats.speculateMs += chrono::duration<double, milli>(middle - start).count();
+        replayStats.commitMs += chrono::duration<double, milli>(end - middle).count();
+    }
+    replayNearest.clear();
+    replayPaths.clear();
 }
-#endif
 
-#if !Mode
-int main() {
-    // 初始化變量
-    string line;
+void runCommands() {
+    if (replayWindow > 0) return replayCommands();
+    for (const Command& command : commands) runCommand(command);
+    flushBatch();
+}
 
-    // 讀取第一行：圖的頂點數、邊數、司機數
-    getline(cin, line);
-    stringstream ss(line);
-    ss >> V >> E >> D;
+// 從檔案描述元逐行讀取，不需要事先知道長度；傳回的行在下一次呼叫前有效
+struct LineReader {
+    int fd;
+    vector<char> buffer;
+    size_t begin = 0, end = 0; // 尚未傳回的資料
+    bool eof = false;
 
-    graph.resize(V + 1);
+    explicit LineReader(int fd) : fd(fd), buffer(1 << 16) {}
+    bool next(const char*& line, const char*& lineEnd) {
+        while (true) {
+            const char* data = buffer.data();
+            if (const char* newline = (const char*)memchr(data + begin, '\n', end - begin)) {
+                line = data + begin;
+                lineEnd = newline;
+                begin = newline - data + 1;
+                return true;
+            }
+            if (eof) { // 最後一行沒有換行
+                if (begin == end) return false;
+                line = data + begin;
+                lineEnd = data + end;
+                begin = end;
+                return true;
+            }
+            if (begin > 0) { // 未完成的行移到開頭，再讀入更多資料
+                memmove(buffer.data(), data + begin, end - begin);
+                end -= begin;
+                begin = 0;
+            }
+            if (end == buffer.size()) buffer.resize(2 * buffer.size());
+            ssize_t n = ::read(fd, buffer.data() + end, buffer.size() - end);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) eof = true;
+            else end += n;
+        }
+    }
+};
 
-    // 讀取司機位置
+// 串流模式：圖與司機照常讀入，之後每讀到一道指令就執行並輸出已經確定的紀錄
+// 同一個訂單編號之後再被指派司機時，檔案模式會改寫它第一筆"from"紀錄，這可能發生在輸入結束前的任何時候，
+// 所以第一筆"from"紀錄與其後的紀錄都留到輸入結束才輸出，輸出與檔案模式完全相同；在那之前的紀錄每道指令後立即輸出
+// 指令數那一行(只有數字的行)與空行略過，指令讀到輸入結束為止
+void runStream(int fd) {
+    LineReader in(fd);
+    const char* line;
+    const char* lineEnd;
+    auto readLine = [&]() {
+        if (!in.next(line, lineEnd)) line = lineEnd = nullptr;
+    };
+    readLine();
+    V = scanInt(line, lineEnd);
+    E = scanInt(line, lineEnd);
+    D = scanInt(line, lineEnd);
     for (int i = 0; i < D; i++) {
-        getline(cin, line);
-        stringstream ss(line);
-        string place;
-        int v, c;
-        ss >> place >> v >> c;
+        readLine();
+        skipWord(line, lineEnd); // PLACE
+        int v = scanInt(line, lineEnd);
+        int c = scanInt(line, lineEnd);
         if (c > 0) {
-            driversAtLocation[v].resize(c, (Driver){v, true});
+            addDrivers(v, c);
+        }
+    }
+    int edges = E > 0 ? E : 0;
+    edgeU.resize(edges);
+    edgeV.resize(edges);
+    edgeDistance.resize(edges);
+    edgeCapacity.resize(edges);
+    for (int i = 0; i < edges; i++) {
+        readLine();
+        skipWord(line, lineEnd); // EDGE
+        edgeU[i] = scanInt(line, lineEnd);
+        edgeV[i] = scanInt(line, lineEnd);
+        edgeDistance[i] = scanInt(line, lineEnd);
+        edgeCapacity[i] = scanInt(line, lineEnd);
+    }
+    buildAdjacency();
+    prepareRouting();
+
+    OutputWriter out;
+    out.open(outputPath, asyncOutput);
+    size_t written = 0; // outputLogs中已輸出的紀錄數
+    auto emit = [&](bool final) { // 輸出到第一筆"from"紀錄之前(輸入結束時全部輸出)，還沒有"from"紀錄時丟棄已輸出的紀錄
+        while (written < outputLogs.size() && (final || outputLogs[written].kind != LogOrderFrom)) {
+            writeLog(out, outputLogs[written++]);
+        }
+        if (orderFromLog.empty()) {
+            outputLogs.clear();
+            written = 0;
         }
+        out.submit();
+    };
+    while (in.next(line, lineEnd)) {
+        const char* p = line;
+        skipBlanks(p, lineEnd);
+        if (p == lineEnd || (*p >= '0' && *p <= '9')) continue;
+        runCommand(parseCommand(line, lineEnd));
+        emit(false);
     }
+    flushBatch();
+    emit(true);
+    out.close();
+}
 
-    // 讀取邊信息
-    for (int i = 0; E > 0 && i < E; i++) {
-        getline(cin, line);
-        stringstream ss(line);
-        string edge;
-        int s, d, dis, t;
-        ss >> edge >> s >> d >> dis >> t;
-        addEdge(s, d, dis, t);
+// 常駐模式(--listen PATH)：地圖與司機只載入一次(輸入中若有指令先照常執行並輸出)，之後在Unix socket上以epoll同時服務大量客戶端
+// 客戶端每行送一道指令，可以連續送出而不等回應；每道指令的回應是它產生的紀錄，以一個空行結尾(空行與只有數字的行不回應)
+// 回應送出後不再改寫：訂單之後改派司機時，該次指令的回應另有一行"Order N from:"，以最後一行為準；
+// 把這些行併回各訂單的第一筆即與檔案模式的輸出相同(測試客戶端的--fold)
+// 同一輪epoll讀到的指令依到達順序執行，回應先累積在各客戶端的緩衝區，整輪處理完才各寫一次
+struct ResponseBuffer {
+    string data;
+    void put(const char* text, size_t length) { data.append(text, length); }
+    void put(char c) { data.push_back(c); }
+    void putInt(int value) {
+        char digits[11];
+        data.append(digits, formatInt(value, digits));
     }
+};
+struct Client {
+    int fd;
+    string input; // 尚未處理的輸入，最後一行可能不完整
+    ResponseBuffer output;
+    size_t sent = 0; // output中已送出的位元組數
+    uint32_t events = 0; // 目前向epoll登記的事件
+    bool closing = false; // 對方已關閉寫入端，回應送完就關閉連線
+};
+struct DaemonStats {
+    long long connections = 0, commands = 0, rounds = 0, writes = 0;
+    size_t peakClients = 0;
+};
+DaemonStats daemonStats;
+const size_t CLIENT_READ_LIMIT = 1 << 16; // 每輪從一個客戶端最多讀這麼多，避免一個客戶端獨佔
+const size_t CLIENT_OUTPUT_LIMIT = 1 << 22; // 未送出的回應超過此值時暫停讀取該客戶端，等它把回應讀走
+const size_t CLIENT_LINE_LIMIT = 1 << 20; // 一行指令的長度上限，超過時視為異常的客戶端並關閉連線，免得輸入緩衝區無限增長
+volatile sig_atomic_t stopDaemon = 0;
 
-    // 跳過空行
-    getline(cin, line);
+void requestStop(int) {
+    stopDaemon = 1;
+}
 
-    // 讀取命令數
-    getline(cin, line);
-    stringstream ss2(line);
-    int C;
-    ss2 >> C;
+struct Daemon {
+    int epoll = -1, listener = -1;
+    vector<unique_ptr<Client>> clients; // 依檔案描述元
+    size_t clientCount = 0;
+    vector<int> touched; // 這一輪有新回應或可寫的客戶端
 
-    // 讀取並處理命令
-    for (int i = 0; i < C; i++) {
-        getline(cin, line);
-        stringstream ss(line);
-        string command;
-        int id, param1, param2;
-        ss >> command >> id;
-        if (command == "Order") {
-            ss >> param1 >> param2;
-            processOrder(id, param1, param2);
-        } else if (command == "Drop") {
-            ss >> param1;
-            dropOrder(id, param1);
-        } else if (command == "Complete") {
-            completeOrder(id);
+    void watch(Client& c, uint32_t events) {
+        if (c.events == events) return;
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = c.fd;
+        epoll_ctl(epoll, EPOLL_CTL_MOD, c.fd, &ev);
+        c.events = events;
+    }
+    void accept() {
+        while (true) {
+            int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return; // EAGAIN：這一輪的連線都接受了；其他錯誤(如檔案描述元用完)下一輪再試
+            if ((size_t)fd >= clients.size()) clients.resize(fd + 1);
+            clients[fd].reset(new Client());
+            Client& c = *clients[fd];
+            c.fd = fd;
+            c.events = EPOLLIN | EPOLLRDHUP;
+            epoll_event ev{};
+            ev.events = c.events;
+            ev.data.fd = fd;
+            epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &ev);
+            daemonStats.connections++;
+            daemonStats.peakClients = max(daemonStats.peakClients, ++clientCount);
         }
     }
-
-    // 輸出所有日志
-    for (const auto& log : outputLogs) {
-        cout << log << endl;
+    void drop(Client& c) {
+        int fd = c.fd;
+        epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+        clients[fd].reset();
+        clientCount--;
+    }
+    // 執行一行指令，回應附加在output
+    void execute(Client& c, const char* line, const char* lineEnd) {
+        const char* q = line;
+        skipBlanks(q, lineEnd);
+        if (q == lineEnd || (*q >= '0' && *q <= '9')) return;
+        runCommand(parseCommand(line, lineEnd));
+        daemonStats.commands++;
+        for (const LogRecord& log : outputLogs) writeLog(c.output, log);
+        outputLogs.clear();
+        c.output.put('\n');
+    }
+    // 讀入並執行完整的行；對方關閉寫入端時，最後一行沒有換行也照樣執行；未完成的一行超過上限時傳回false
+    bool receive(Client& c) {
+        char buffer[1 << 14];
+        size_t total = 0;
+        bool eof = false;
+        while (total < CLIENT_READ_LIMIT) {
+            ssize_t n = ::read(c.fd, buffer, sizeof buffer);
+            if (n > 0) {
+                c.input.append(buffer, n);
+                total += n;
+                continue;
+            }
+            if (n == 0) c.closing = eof = true;
+            else if (errno == EINTR) continue;
+            else if (errno != EAGAIN && errno != EWOULDBLOCK) c.closing = true;
+            break;
+        }
+        const char* begin = c.input.data();
+        const char* end = begin + c.input.size();
+        const char* p = begin;
+        while (const char* newline = (const char*)memchr(p, '\n', end - p)) {
+            execute(c, p, newline);
+            p = newline + 1;
+        }
+        if (eof && p != end) {
+            execute(c, p, end);
+            p = end;
+        }
+        c.input.erase(0, p - begin);
+        return c.input.size() <= CLIENT_LINE_LIMIT;
+    }
+    // 送出累積的回應；送不完就等可寫，回應太多就暫停讀取；對方已關閉且送完時傳回false
+    bool flush(Client& c) {
+        string& data = c.output.data;
+        while (c.sent < data.size()) {
+            ssize_t n = ::send(c.fd, data.data() + c.sent, data.size() - c.sent, MSG_NOSIGNAL);
+            if (n > 0) {
+                c.sent += n;
+                daemonStats.writes++;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            return false; // 對方已斷線
+        }
+        if (c.sent == data.size()) {
+            data.clear();
+            c.sent = 0;
+        }
+        size_t pending = data.size() - c.sent;
+        if (c.closing && pending == 0) return false;
+        uint32_t events = 0;
+        if (!c.closing && pending < CLIENT_OUTPUT_LIMIT) events |= EPOLLIN | EPOLLRDHUP;
+        if (pending > 0) events |= EPOLLOUT;
+        watch(c, events);
+        return true;
+    }
+    int run() {
+        listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (listener < 0 || listenPath.size() >= sizeof address.sun_path) {
+            cerr << "cannot listen on: " << listenPath << endl;
+            return 1;
+        }
+        memcpy(address.sun_path, listenPath.c_str(), listenPath.size() + 1);
+        ::unlink(listenPath.c_str()); // 上次留下的socket檔
+        if (::bind(listener, (sockaddr*)&address, sizeof address) < 0 || ::listen(listener, SOMAXCONN) < 0) {
+            cerr << "cannot listen on: " << listenPath << endl;
+            return 1;
+        }
+        struct sigaction stop{};
+        stop.sa_handler = requestStop; // 不設SA_RESTART，epoll_wait才會被中斷
+        sigaction(SIGINT, &stop, nullptr);
+        sigaction(SIGTERM, &stop, nullptr);
+        epoll = epoll_create1(EPOLL_CLOEXEC);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = listener;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &ev);
+        serving = true;
+        vector<epoll_event> events(1024);
+        while (!stopDaemon) {
+            int n = epoll_wait(epoll, events.data(), events.size(), -1);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            daemonStats.rounds++;
+            touched.clear();
+            for (int i = 0; i < n; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == listener) {
+                    accept();
+                    continue;
+                }
+                Client& c = *clients[fd];
+                // 連線已斷(EPOLLHUP)或出錯時回應送不出去，不論是否因回應積壓而暫停讀取都直接關閉
+                if ((events[i].events & (EPOLLHUP | EPOLLERR)) ||
+                    ((events[i].events & (EPOLLIN | EPOLLRDHUP)) && !receive(c))) {
+                    drop(c);
+                    continue;
+                }
+                touched.push_back(fd);
+            }
+            for (int fd : touched) {
+                if (clients[fd] && !flush(*clients[fd])) drop(*clients[fd]);
+            }
+        }
+        for (auto& c : clients) {
+            if (c) drop(*c);
+        }
+        ::close(epoll);
+        ::close(listener);
+        ::unlink(listenPath.c_str());
+        if (printStats) {
+            const DaemonStats& ds = daemonStats;
+            cerr << "daemon: " << ds.connections << " connections (peak " << ds.peakClients << " at once), " << ds.commands
+                 << " commands in " << ds.rounds << " rounds, " << ds.writes << " writes" << endl;
+        }
+        return 0;
     }
+};
 
+// 測試客戶端(--connect PATH)：從輸入讀取指令行，開--clients條連線輪流分配，每條連線把指令全部連續送出，
+// 邊送邊收，直到每道指令的回應都收到為止；只有一條連線時把回應(不含結尾的空行)依序輸出到標準輸出，
+// 指定--fold時先把改派司機的"from"行併回各訂單的第一筆，全部收完才輸出
+int runClient(int fd) {
+    vector<string> lines;
+    vector<string> folded; // --fold：併好的輸出行
+    unordered_map<int, size_t> foldedFrom; // 訂單編號 -> 該訂單第一筆"from"行在folded中的位置
+    auto fold = [&](const string& response) {
+        size_t begin = 0;
+        while (begin < response.size()) {
+            size_t end = response.find('\n', begin);
+            string text = response.substr(begin, end - begin);
+            begin = end + 1;
+            size_t from = text.find(" from: ");
+            if (text.compare(0, 6, "Order ") == 0 && from != string::npos) {
+                auto inserted = foldedFrom.emplace(atoi(text.c_str() + 6), folded.size());
+                if (!inserted.second) {
+                    folded[inserted.first->second] = text;
+                    continue;
+                }
+            }
+            folded.push_back(text);
+        }
+    };
+    LineReader in(fd);
+    const char* line;
+    const char* lineEnd;
+    while (in.next(line, lineEnd)) {
+        const char* p = line;
+        skipBlanks(p, lineEnd);
+        if (p == lineEnd || (*p >= '0' && *p <= '9')) continue; // 伺服器不回應的行不送
+        lines.push_back(string(line, lineEnd));
+    }
+    struct Connection {
+        int fd;
+        string request, response;
+        size_t sent = 0;
+        long long expected = 0, received = 0; // 送出的指令數與收到的回應數
+    };
+    vector<Connection> connections(clientConnections);
+    for (size_t i = 0; i < lines.size(); ++i) {
+        Connection& c = connections[i % clientConnections];
+        c.request += lines[i];
+        c.request += '\n';
+        c.expected++;
+    }
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (connectPath.size() >= sizeof address.sun_path) {
+        cerr << "cannot connect to: " << connectPath << endl;
+        return 1;
+    }
+    memcpy(address.sun_path, connectPath.c_str(), connectPath.size() + 1);
+    auto start = chrono::steady_clock::now();
+    for (Connection& c : connections) {
+        c.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (c.fd < 0 || ::connect(c.fd, (sockaddr*)&address, sizeof address) < 0) {
+            cerr << "cannot connect to: " << connectPath << endl;
+            return 1;
+        }
+        fcntl(c.fd, F_SETFL, O_NONBLOCK);
+    }
+    vector<pollfd> polls;
+    size_t open = connections.size();
+    char buffer[1 << 14];
+    while (open > 0) {
+        polls.clear();
+        for (const Connection& c : connections) {
+            if (c.received == c.expected) continue;
+            short events = POLLIN;
+            if (c.sent < c.request.size()) events |= POLLOUT;
+            polls.push_back(pollfd{c.fd, events, 0});
+        }
+        if (poll(polls.data(), polls.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        size_t k = 0;
+        for (Connection& c : connections) {
+            if (c.received == c.expected) continue;
+            const pollfd& pf = polls[k++];
+            if ((pf.revents & POLLOUT) && c.sent < c.request.size()) {
+                ssize_t n = ::send(c.fd, c.request.data() + c.sent, c.request.size() - c.sent, MSG_NOSIGNAL);
+                if (n > 0) c.sent += n;
+            }
+            if (pf.revents & (POLLIN | POLLHUP | POLLERR)) {
+                ssize_t n = ::read(c.fd, buffer, sizeof buffer);
+                if (n <= 0 && !(n < 0 && (errno == EAGAIN || errno == EINTR))) {
+                    cerr << "connection closed by server" << endl;
+                    return 1;
+                }
+                for (ssize_t i = 0; i < n; ++i) {
+                    // 回應以空行結尾：換行緊接在換行(或回應開頭)之後
+                    if (buffer[i] == '\n' && (c.response.empty() || c.response.back() == '\n')) {
+                        c.received++;
+                        if (clientConnections == 1 && foldResponses) fold(c.response);
+                        else if (clientConnections == 1) fwrite(c.response.data(), 1, c.response.size(), stdout);
+                        c.response.clear();
+                    } else {
+                        c.response.push_back(buffer[i]);
+                    }
+                }
+                if (c.received == c.expected) open--;
+            }
+        }
+    }
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    for (const Connection& c : connections) ::close(c.fd);
+    for (const string& text : folded) {
+        fwrite(text.data(), 1, text.size(), stdout);
+        fputc('\n', stdout);
+    }
+    fflush(stdout);
+    if (printStats) {
+        cerr << "client: " << lines.size() << " commands over " << clientConnections << " connections in " << ms
+             << " ms (" << (ms > 0 ? lines.size() * 1000.0 / ms : 0) << " commands/s)" << endl;
+    }
     return 0;
 }
 
-#endif"
+int main(int argc, char* argv[]) {
+    parseOptions(argc, argv);
+    if (benchmark == QueueBenchmark) return runQueueBenchmark();
+    if (benchmark == VoronoiBenchmark) return runVoronoiBenchmark();
+    if (benchmark == BatchBenchmark) return runBatchBenchmark();
+
+    int fd = 0; // 預設讀標準輸入
+    if (!inputPath.empty()) {
+        fd = ::open(inputPath.c_str(), O_RDONLY);
+        if (fd < 0) {
+            cerr << "cannot open input: " << inputPath << endl;
+            return 1;
+        }
+    }
+    if (!connectPath.empty()) {
+        int status = runClient(fd);
+        if (fd != 0) ::close(fd);
+        return status;
+    }
+    if (streamMode) {
+        runStream(fd);
+    } else {
+        // 讀取整份輸入：圖的頂點數、邊數、司機數，司機位置，邊信息，命令
+        auto start = chrono::steady_clock::now();
+        InputFile input;
+        if (!input.open(fd)) {
+            cerr << "cannot read input" << endl;
+            return 1;
+        }
+        startupStats.read = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        loadInput(input);
+
+        // 處理命令
+        runCommands();
+
+        // 輸出所有日志
+        printLogs();
+        outputLogs.clear();
+    }
+    if (!listenPath.empty()) {
+        Daemon daemon;
+        if (daemon.run() != 0) return 1;
+    }
+    if (fd != 0) ::close(fd);
+#if CountAllocations
+    cerr << "routing allocations: " << routingAllocations << " in " << routedOrders << " searches" << endl;
+#endif
+    if (printStats) reportStats();
+
+    return 0;
+}